@@ -0,0 +1,193 @@
+# Offline mip chain baker for the billboard textures.
+#
+# GenTextureMipmaps/ImageMipmaps don't work for the web build (WebGL1 can't mip
+# non power of two textures), so the chains are baked here at build time and the
+# game uploads them as is.
+#
+# usage: bake_mips.py input.png output.mip
+#
+# .mip layout (little endian):
+#   u32 magic 'SFMP', u32 version,
+#   s32 width, s32 height               (size of the source png, what the game lays out with)
+#   s32 stored_width, s32 stored_height (power of two size of level 0)
+#   s32 mip_count
+#   then mip_count levels of RGBA8, each half the size of the previous one (min 1)
+import struct
+import sys
+import zlib
+
+MIP_MAGIC = 0x504d4653 # 'SFMP'
+MIP_VERSION = 1
+
+def decode_png(path):
+  # NOTE: Returns width, height and the pixels as straight alpha RGBA8 bytes
+  with open(path, 'rb') as f:
+    data = f.read()
+  if data[:8] != b'\x89PNG\r\n\x1a\n':
+    raise ValueError(path + ': not a png')
+
+  pos = 8
+  idat = b''
+  palette = None
+  transparency = None
+  while pos < len(data):
+    length, chunk_type = struct.unpack('>I4s', data[pos:pos + 8])
+    chunk = data[pos + 8:pos + 8 + length]
+    pos += 12 + length
+    if chunk_type == b'IHDR':
+      width, height, bit_depth, color_type, _, _, interlace = struct.unpack('>IIBBBBB', chunk)
+    elif chunk_type == b'PLTE':
+      palette = chunk
+    elif chunk_type == b'tRNS':
+      transparency = chunk
+    elif chunk_type == b'IDAT':
+      idat += chunk
+    elif chunk_type == b'IEND':
+      break
+
+  channels = {0: 1, 2: 3, 3: 1, 4: 2, 6: 4}[color_type]
+  if bit_depth != 8 or interlace != 0:
+    raise ValueError(path + ': only 8 bit non interlaced pngs are supported')
+
+  raw = zlib.decompress(idat)
+  stride = width*channels
+  rows = []
+  prev = bytearray(stride)
+  pos = 0
+  for y in range(height):
+    filter_type = raw[pos]
+    line = bytearray(raw[pos + 1:pos + 1 + stride])
+    pos += 1 + stride
+    for x in range(stride):
+      a = line[x - channels] if x >= channels else 0
+      b = prev[x]
+      c = prev[x - channels] if x >= channels else 0
+      if filter_type == 1:
+        line[x] = (line[x] + a) & 0xff
+      elif filter_type == 2:
+        line[x] = (line[x] + b) & 0xff
+      elif filter_type == 3:
+        line[x] = (line[x] + ((a + b) >> 1)) & 0xff
+      elif filter_type == 4:
+        p = a + b - c
+        pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+        predictor = a if (pa <= pb and pa <= pc) else (b if pb <= pc else c)
+        line[x] = (line[x] + predictor) & 0xff
+    rows.append(line)
+    prev = line
+
+  rgba = bytearray()
+  for line in rows:
+    for x in range(width):
+      px = line[x*channels:(x + 1)*channels]
+      if color_type == 6:
+        r, g, b, alpha = px
+      elif color_type == 2:
+        r, g, b = px
+        alpha = 255
+      elif color_type == 4:
+        r = g = b = px[0]
+        alpha = px[1]
+      elif color_type == 0:
+        r = g = b = px[0]
+        alpha = 255
+      else:
+        i = px[0]
+        r, g, b = palette[3*i:3*i + 3]
+        alpha = transparency[i] if (transparency and i < len(transparency)) else 255
+      rgba += bytes((r, g, b, alpha))
+
+  return width, height, rgba
+
+def read_png(path):
+  # NOTE: pixels as premultiplied float rgba, so filtering doesn't bleed the color of transparent texels
+  width, height, rgba = decode_png(path)
+  pixels = []
+  for i in range(0, len(rgba), 4):
+    r, g, b, alpha = rgba[i:i + 4]
+    af = alpha/255.0
+    pixels.append((r*af, g*af, b*af, float(alpha)))
+
+  return width, height, pixels
+
+def next_power_of_two(value):
+  result = 1
+  while result < value:
+    result *= 2
+  return result
+
+def resample(width, height, pixels, new_width, new_height):
+  # NOTE: Bilinear, texel centers line up at the edges
+  result = []
+  for y in range(new_height):
+    fy = max(0.0, (y + 0.5)*height/new_height - 0.5)
+    y0 = min(int(fy), height - 1)
+    y1 = min(y0 + 1, height - 1)
+    ty = fy - y0
+    for x in range(new_width):
+      fx = max(0.0, (x + 0.5)*width/new_width - 0.5)
+      x0 = min(int(fx), width - 1)
+      x1 = min(x0 + 1, width - 1)
+      tx = fx - x0
+      p00 = pixels[y0*width + x0]
+      p10 = pixels[y0*width + x1]
+      p01 = pixels[y1*width + x0]
+      p11 = pixels[y1*width + x1]
+      result.append(tuple(
+        (1 - ty)*((1 - tx)*p00[c] + tx*p10[c]) + ty*((1 - tx)*p01[c] + tx*p11[c])
+        for c in range(4)))
+  return result
+
+def downsample(width, height, pixels):
+  new_width = max(width//2, 1)
+  new_height = max(height//2, 1)
+  result = []
+  for y in range(new_height):
+    sy0 = min(2*y, height - 1)
+    sy1 = min(2*y + 1, height - 1)
+    for x in range(new_width):
+      sx0 = min(2*x, width - 1)
+      sx1 = min(2*x + 1, width - 1)
+      p = (pixels[sy0*width + sx0], pixels[sy0*width + sx1],
+           pixels[sy1*width + sx0], pixels[sy1*width + sx1])
+      result.append(tuple(0.25*(p[0][c] + p[1][c] + p[2][c] + p[3][c]) for c in range(4)))
+  return new_width, new_height, result
+
+def encode_level(pixels):
+  out = bytearray()
+  for r, g, b, alpha in pixels:
+    if alpha > 0.0:
+      scale = 255.0/alpha
+      out += bytes((min(255, int(r*scale + 0.5)), min(255, int(g*scale + 0.5)),
+                    min(255, int(b*scale + 0.5)), min(255, int(alpha + 0.5))))
+    else:
+      out += bytes(4)
+  return out
+
+def main():
+  if len(sys.argv) != 3:
+    print('usage: bake_mips.py input.png output.mip')
+    sys.exit(1)
+
+  width, height, pixels = read_png(sys.argv[1])
+  stored_width = next_power_of_two(width)
+  stored_height = next_power_of_two(height)
+
+  level_width, level_height = stored_width, stored_height
+  level = pixels
+  if (stored_width, stored_height) != (width, height):
+    level = resample(width, height, pixels, stored_width, stored_height)
+
+  levels = [encode_level(level)]
+  while level_width > 1 or level_height > 1:
+    level_width, level_height, level = downsample(level_width, level_height, level)
+    levels.append(encode_level(level))
+
+  with open(sys.argv[2], 'wb') as f:
+    f.write(struct.pack('<IIiiiii', MIP_MAGIC, MIP_VERSION, width, height,
+                        stored_width, stored_height, len(levels)))
+    for data in levels:
+      f.write(data)
+
+if __name__ == '__main__':
+  main()
@@ -5,7 +5,15 @@ pushd ..\..\build_jam
 
 REM C:/emsdk/emsdk activate latest --permanent
 
-emcc -o road.html ../blockborngame/code/main.cpp -Wall -std=c++17 -D_DEFAULT_SOURCE -Wno-missing-braces -Wunused-result -Os -I. -I D:/raylib/raylib/src -I D:/raylib/raylib/src/external -L. -L D:/raylib/raylib/src -s USE_GLFW=3 -s ASYNCIFY -s TOTAL_MEMORY=67108864 -s FORCE_FILESYSTEM=1 --preload-file ../blockborngame/data@ --shell-file D:/raylib/raylib/src/shell.html D:/raylib/raylib/src/web/libraylib.a -DPLATFORM_WEB -s EXPORTED_FUNCTIONS=["_free","_malloc","_main"] -s EXPORTED_RUNTIME_METHODS=ccall -s ASSERTIONS=1
+REM Offline mip chains for the billboards, see bake_mips.py
+IF NOT EXIST mips mkdir mips
+FOR %%T IN (tree building_left building_right skyscraper_left skyscraper_right lantern_left lantern_right civil_car) DO python ../blockborngame/code/bake_mips.py ../blockborngame/data/%%T.png mips/%%T.mip
+REM Compact 4 bit sfx, see encode_sfx.py. The wavs go into the pack too, it keeps the ones whose .sfa came out empty
+FOR %%S IN (..\blockborngame\data\*.wav) DO python ../blockborngame/code/encode_sfx.py %%S mips/%%~nS.sfa
+REM Deflated for the web, the game inflates while loading. Only the pack and the shaders (loaded by name) get preloaded
+python ../blockborngame/code/pack_assets.py --deflate mips/assets.pak ../blockborngame/data/*.png ../blockborngame/data/*.mp3 mips/*.mip mips/*.sfa ../blockborngame/data/*.wav
+
+emcc -o road.html ../blockborngame/code/main.cpp -Wall -std=c++17 -D_DEFAULT_SOURCE -Wno-missing-braces -Wunused-result -Os -I. -I D:/raylib/raylib/src -I D:/raylib/raylib/src/external -L. -L D:/raylib/raylib/src -s USE_GLFW=3 -s ASYNCIFY -s TOTAL_MEMORY=67108864 -s FORCE_FILESYSTEM=1 --preload-file mips/assets.pak@assets.pak --preload-file ../blockborngame/data/crt.fs@crt.fs --preload-file ../blockborngame/data/skyline.fs@skyline.fs --shell-file D:/raylib/raylib/src/shell.html D:/raylib/raylib/src/web/libraylib.a -DPLATFORM_WEB -s EXPORTED_FUNCTIONS=["_free","_malloc","_main"] -s EXPORTED_RUNTIME_METHODS=ccall -s ASSERTIONS=1
 
 REM Maybe better sound: -s USE_SDL=2
 REM Include before --shell-fil
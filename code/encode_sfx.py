@@ -0,0 +1,157 @@
+# Encodes 16 bit wavs into a compact 4 bit adpcm format (.sfa) the game decodes with SIMD,
+# about 3.5x smaller than the pcm. Lossy, meant for sound effects.
+#
+# usage: encode_sfx.py input.wav output.sfa
+#
+# Every channel is cut into blocks of 256 samples that decode on their own (they store
+# their own predictor history), 8 of those blocks get interleaved into a group so the
+# decoder can run all 8 in the lanes of one 16 bit SIMD register. A block is 16 slices
+# of 16 samples, each slice with its own scale and predictor:
+#   prediction = 0, s1, s1 + (s1 - s2)/2 or s1 + (s1 - s2) (predictor 0..3), saturated to 16 bit
+#   sample = prediction + code*SCALES[scale], saturated to 16 bit, code in -8..7
+# The zero predictor is for noisy slices where the previous sample is a worse guess than
+# silence, the scales step by ~1.3x instead of 2x.
+#
+# .sfa layout (little endian):
+#   u32 magic 'SFAD', u32 version,
+#   s32 channels (1 or 2), s32 sample_rate, s32 frame_count, s32 group_count
+#   then group_count groups of:
+#     s16 s1[8], s16 s2[8]  (history of each lane's block)
+#     16 slices of:
+#       u8 header[8]        (per lane: scale index in the low 5 bits, predictor in the next 2)
+#       16 x u8 codes[4]    (per sample, lane 2i in the low nibble, lane 2i + 1 in the high one)
+#
+# Lane l of a group holds channel l % channels of block l // channels, so a stereo group
+# covers 4*256 frames and a mono one 8*256.
+#
+# Sounds that come out below MIN_SNR_DB get an empty output file instead (so the build
+# has its output and doesn't rerun), pack_assets.py then packs the pcm wav for them.
+import math
+import struct
+import sys
+
+from pack_assets import decode_wav
+
+SFA_MAGIC = 0x44414653 # 'SFAD'
+SFA_VERSION = 2
+
+LANES = 8
+SLICE_SAMPLES = 16
+SLICES = 16
+BLOCK_SAMPLES = SLICE_SAMPLES*SLICES
+MIN_SNR_DB = 30.0
+
+# NOTE: Linear at the bottom, then geometric up to 4096 (8*4096 still fits 16 bit)
+SCALES = (1, 2, 3, 4, 5, 6, 7, 8, 9, 11, 15, 19, 25, 33, 43, 56,
+          73, 96, 125, 164, 214, 280, 366, 479, 626, 819, 1071, 1400, 1831, 2395, 3132, 4096)
+PREDICTORS = 4
+
+def sat16(value):
+  return -32768 if value < -32768 else (32767 if value > 32767 else value)
+
+def predict(predictor, s1, s2):
+  if predictor == 0:
+    return 0
+  if predictor == 1:
+    return s1
+  slope = sat16(s1 - s2)
+  return sat16(s1 + (slope >> 1 if predictor == 2 else slope))
+
+def encode_slice(samples, s1, s2):
+  # NOTE: Picks the predictor and scale with the least squared error, by running the decoder
+  best = None
+  for predictor in range(PREDICTORS):
+    # NOTE: Around the smallest scale the open loop residuals fit in, the closed loop drifts off that
+    p1, p2 = s1, s2
+    peak = 0
+    for sample in samples:
+      peak = max(peak, abs(sample - predict(predictor, p1, p2)))
+      p1, p2 = sample, p1
+    fit = 0
+    while fit < len(SCALES) - 1 and 7*SCALES[fit] < peak:
+      fit += 1
+
+    for scale_index in range(max(fit - 3, 0), min(fit + 2, len(SCALES))):
+      scale = SCALES[scale_index]
+      p1, p2 = s1, s2
+      errors = []
+      codes = []
+      for sample in samples:
+        prediction = predict(predictor, p1, p2)
+        code = int(round((sample - prediction)/scale))
+        code = -8 if code < -8 else (7 if code > 7 else code)
+        decoded = sat16(prediction + code*scale)
+        errors.append((sample - decoded)*(sample - decoded))
+        codes.append(code)
+        p1, p2 = decoded, p1
+      if best is None or sum(errors) < sum(best[0]):
+        best = (errors, (predictor << 5) | scale_index, codes, p1, p2)
+
+  # NOTE: Squared error of every sample goes last
+  return best[1:] + best[:1]
+
+def main():
+  if len(sys.argv) != 3:
+    print('usage: encode_sfx.py input.wav output.sfa')
+    sys.exit(1)
+
+  (frame_count, sample_rate, sample_size, channels, _), data = decode_wav(sys.argv[1])
+  if sample_size != 16 or channels not in (1, 2):
+    raise ValueError(sys.argv[1] + ': only 16 bit mono/stereo wavs are supported')
+
+  pcm = struct.unpack('<%dh' % (frame_count*channels), data[:2*frame_count*channels])
+  channel_samples = [pcm[c::channels] for c in range(channels)]
+
+  group_frames = (LANES//channels)*BLOCK_SAMPLES
+  group_count = (frame_count + group_frames - 1)//group_frames
+
+  out = bytearray(struct.pack('<IIiiii', SFA_MAGIC, SFA_VERSION, channels, sample_rate,
+                              frame_count, group_count))
+  noise = 0
+  for group_index in range(group_count):
+    lane_samples = []
+    lane_history = []
+    lane_starts = []
+    for lane in range(LANES):
+      channel = lane % channels
+      start = group_index*group_frames + (lane//channels)*BLOCK_SAMPLES
+      samples = channel_samples[channel]
+      block = list(samples[start:start + BLOCK_SAMPLES])
+      block += [0]*(BLOCK_SAMPLES - len(block))
+      lane_samples.append(block)
+      lane_history.append((samples[start - 1] if 1 <= start <= len(samples) else 0,
+                           samples[start - 2] if 2 <= start <= len(samples) else 0))
+      lane_starts.append(start)
+
+    out += struct.pack('<8h', *[history[0] for history in lane_history])
+    out += struct.pack('<8h', *[history[1] for history in lane_history])
+
+    for slice_index in range(SLICES):
+      headers = []
+      lane_codes = []
+      for lane in range(LANES):
+        s1, s2 = lane_history[lane]
+        first = slice_index*SLICE_SAMPLES
+        header, codes, s1, s2, errors = encode_slice(lane_samples[lane][first:first + SLICE_SAMPLES], s1, s2)
+        lane_history[lane] = (s1, s2)
+        # NOTE: Padding past the end doesn't get played, so it doesn't count
+        noise += sum(errors[:max(0, frame_count - (lane_starts[lane] + first))])
+        headers.append(header)
+        lane_codes.append(codes)
+
+      out += bytes(headers)
+      for i in range(SLICE_SAMPLES):
+        for lane in range(0, LANES, 2):
+          out.append((lane_codes[lane][i] & 0xf) | ((lane_codes[lane + 1][i] & 0xf) << 4))
+
+  signal = sum(sample*sample for sample in pcm)
+  snr = 10.0*math.log10(signal/noise) if noise and signal else math.inf
+  if snr < MIN_SNR_DB:
+    print('%s: %.1f dB SNR is below %.1f dB, keeping it as pcm' % (sys.argv[1], snr, MIN_SNR_DB))
+    out = bytearray()
+
+  with open(sys.argv[2], 'wb') as f:
+    f.write(out)
+
+if __name__ == '__main__':
+  main()
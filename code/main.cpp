@@ -1,10 +1,41 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "raylib.h"
 #include "rlgl.h"
 #include "raymath.h"
 
+#if defined(__AVX__) || defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+#include <atomic>
+#ifndef __EMSCRIPTEN__
+#include <chrono>
+#include <thread>
+#endif
+
+//NOTE(moritz): The mp3 decoder raylib is built with, for streaming music on our own thread
+#if __has_include("external/dr_mp3.h")
+#define MUSIC_STREAM_DECODER
+#include "external/dr_mp3.h"
+#endif
+
+//NOTE(moritz): The inflater raylib is built with, for deflated asset pack entries. Not DecompressData,
+//that one wants a 64MB scratch buffer, which is the whole web heap.
+#if __has_include("external/sinfl.h")
+#define ASSET_PACK_INFLATE
+#include "external/sinfl.h"
+#endif
+
+//NOTE(moritz): The asset pack gets mmapped where that's easy, everywhere else it is read in one go
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#define ASSET_PACK_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #define global static
 
 #define F32Max 3.402823e+38f
@@ -21,7 +52,7 @@
 
 #define WEB_BUILD
 
-#define THINGS_PER_BAND 16
+//#define COLLISION_VALIDATION
 
 struct tweak_entry
 {
@@ -195,6 +226,85 @@ LerpM(Color A, float t, Color B)
 	return(Result);
 }
 
+/*
+NOTE(moritz):
+Minimal lane wrapper for evaluating several cubics/segments at once.
+8 lanes with AVX, 4 with SSE (also what wasm SIMD maps to), 4 plain floats otherwise.
+Comparisons return all bits set per passing lane, like the SSE/AVX ones.
+*/
+#if defined(__AVX__)
+
+#define LANE_WIDTH 8
+typedef __m256 lane_f32;
+
+inline lane_f32 LaneF32(float A) { return(_mm256_set1_ps(A)); }
+inline lane_f32 LaneLoad(float *A) { return(_mm256_loadu_ps(A)); }
+inline void LaneStore(float *Dest, lane_f32 A) { _mm256_storeu_ps(Dest, A); }
+inline lane_f32 LaneAdd(lane_f32 A, lane_f32 B) { return(_mm256_add_ps(A, B)); }
+inline lane_f32 LaneSub(lane_f32 A, lane_f32 B) { return(_mm256_sub_ps(A, B)); }
+inline lane_f32 LaneMul(lane_f32 A, lane_f32 B) { return(_mm256_mul_ps(A, B)); }
+inline lane_f32 LaneAnd(lane_f32 A, lane_f32 B) { return(_mm256_and_ps(A, B)); }
+inline lane_f32 LaneXor(lane_f32 A, lane_f32 B) { return(_mm256_xor_ps(A, B)); }
+inline lane_f32 LaneGreater(lane_f32 A, lane_f32 B) { return(_mm256_cmp_ps(A, B, _CMP_GT_OQ)); }
+inline lane_f32 LaneGreaterEqual(lane_f32 A, lane_f32 B) { return(_mm256_cmp_ps(A, B, _CMP_GE_OQ)); }
+inline unsigned int LaneMask(lane_f32 A) { return((unsigned int)_mm256_movemask_ps(A)); }
+
+#elif defined(__SSE__)
+
+#define LANE_WIDTH 4
+typedef __m128 lane_f32;
+
+inline lane_f32 LaneF32(float A) { return(_mm_set1_ps(A)); }
+inline lane_f32 LaneLoad(float *A) { return(_mm_loadu_ps(A)); }
+inline void LaneStore(float *Dest, lane_f32 A) { _mm_storeu_ps(Dest, A); }
+inline lane_f32 LaneAdd(lane_f32 A, lane_f32 B) { return(_mm_add_ps(A, B)); }
+inline lane_f32 LaneSub(lane_f32 A, lane_f32 B) { return(_mm_sub_ps(A, B)); }
+inline lane_f32 LaneMul(lane_f32 A, lane_f32 B) { return(_mm_mul_ps(A, B)); }
+inline lane_f32 LaneAnd(lane_f32 A, lane_f32 B) { return(_mm_and_ps(A, B)); }
+inline lane_f32 LaneXor(lane_f32 A, lane_f32 B) { return(_mm_xor_ps(A, B)); }
+inline lane_f32 LaneGreater(lane_f32 A, lane_f32 B) { return(_mm_cmpgt_ps(A, B)); }
+inline lane_f32 LaneGreaterEqual(lane_f32 A, lane_f32 B) { return(_mm_cmpge_ps(A, B)); }
+inline unsigned int LaneMask(lane_f32 A) { return((unsigned int)_mm_movemask_ps(A)); }
+
+#else
+
+#define LANE_WIDTH 4
+struct lane_f32
+{
+	float E[LANE_WIDTH];
+};
+
+inline lane_f32 LaneF32(float A) { lane_f32 R; for(int I = 0; I < LANE_WIDTH; ++I) R.E[I] = A; return(R); }
+inline lane_f32 LaneLoad(float *A) { lane_f32 R; for(int I = 0; I < LANE_WIDTH; ++I) R.E[I] = A[I]; return(R); }
+inline void LaneStore(float *Dest, lane_f32 A) { for(int I = 0; I < LANE_WIDTH; ++I) Dest[I] = A.E[I]; }
+inline lane_f32 LaneAdd(lane_f32 A, lane_f32 B) { lane_f32 R; for(int I = 0; I < LANE_WIDTH; ++I) R.E[I] = A.E[I] + B.E[I]; return(R); }
+inline lane_f32 LaneSub(lane_f32 A, lane_f32 B) { lane_f32 R; for(int I = 0; I < LANE_WIDTH; ++I) R.E[I] = A.E[I] - B.E[I]; return(R); }
+inline lane_f32 LaneMul(lane_f32 A, lane_f32 B) { lane_f32 R; for(int I = 0; I < LANE_WIDTH; ++I) R.E[I] = A.E[I]*B.E[I]; return(R); }
+
+inline unsigned int LaneBits(float A) { unsigned int R; memcpy(&R, &A, sizeof(R)); return(R); }
+inline float LaneFloat(unsigned int A) { float R; memcpy(&R, &A, sizeof(R)); return(R); }
+
+inline lane_f32 LaneAnd(lane_f32 A, lane_f32 B) { lane_f32 R; for(int I = 0; I < LANE_WIDTH; ++I) R.E[I] = LaneFloat(LaneBits(A.E[I]) & LaneBits(B.E[I])); return(R); }
+inline lane_f32 LaneXor(lane_f32 A, lane_f32 B) { lane_f32 R; for(int I = 0; I < LANE_WIDTH; ++I) R.E[I] = LaneFloat(LaneBits(A.E[I]) ^ LaneBits(B.E[I])); return(R); }
+inline lane_f32 LaneGreater(lane_f32 A, lane_f32 B) { lane_f32 R; for(int I = 0; I < LANE_WIDTH; ++I) R.E[I] = LaneFloat((A.E[I] > B.E[I]) ? U32Max : 0); return(R); }
+inline lane_f32 LaneGreaterEqual(lane_f32 A, lane_f32 B) { lane_f32 R; for(int I = 0; I < LANE_WIDTH; ++I) R.E[I] = LaneFloat((A.E[I] >= B.E[I]) ? U32Max : 0); return(R); }
+inline unsigned int LaneMask(lane_f32 A) { unsigned int R = 0; for(int I = 0; I < LANE_WIDTH; ++I) R |= (LaneBits(A.E[I]) >> 31) << I; return(R); }
+
+#endif
+
+//NOTE(moritz): Uniform t steps the curve gets forward differenced with before resampling it by y,
+//and how often the stepping gets re-anchored to the exact polynomial
+#define ROAD_LUT_DENSE_STEPS 1024
+#define ROAD_FD_ANCHOR_INTERVAL 64
+
+//NOTE(moritz): Samples per Bezier road segment, uniform in y. A segment spans one screen worth of depth lines.
+#define ROAD_LUT_SAMPLES 256
+
+//NOTE(moritz): Max x error (in pixels) of a LUT lookup against evaluating the curve directly
+#define ROAD_LUT_MAX_ERROR 0.25f
+
+//#define ROAD_LUT_VALIDATION
+
 struct road_segment
 {
 	//float Length;
@@ -203,6 +313,27 @@ struct road_segment
 	
 	float ddX;
 	
+	//NOTE(moritz): Bezier road model (see RoadModel_Bezier).
+	//Segment space: y goes from 0 (at Position) to 1 (at Position + 1), x is in pixels.
+	//Basis (3rd degree)
+	Vector2 Start;
+	Vector2 C0;
+	Vector2 C1;
+	Vector2 End;
+	
+	//1st derivative (2nd degree) - Velocity
+	Vector2 VStart;
+	Vector2 VC0;
+	Vector2 VEnd;
+	
+	//2nd derivative (1st degree) - Acceleration
+	Vector2 AStart;
+	Vector2 AEnd;
+	
+	//NOTE(moritz): Curve resampled at uniform y (y = Index/ROAD_LUT_SAMPLES), with the matching curve parameter t
+	float LUTX[ROAD_LUT_SAMPLES + 1];
+	float LUTt[ROAD_LUT_SAMPLES + 1];
+	
 	road_segment *Next;
 };
 
@@ -647,516 +778,4727 @@ RandomBilateral(random_series *Series)
 	return(Result);
 }
 
+enum road_model
+{
+	RoadModel_ddX,
+	RoadModel_Bezier,
+	
+	RoadModel_Count,
+};
+
+const char *RoadModelNames[RoadModel_Count] =
+{
+	"ddX",
+	"Bezier",
+};
+
+Vector2
+Bezier2(Vector2 A, Vector2 B, Vector2 C, float t)
+{
+	Vector2 P0 = LerpM(A, t, B);
+	Vector2 P1 = LerpM(B, t, C);
+	
+	Vector2 Result = LerpM(P0, t, P1);
+	return(Result);
+}
+
+Vector2
+Bezier3(Vector2 A, Vector2 B, Vector2 C, Vector2 D, float t)
+{
+	//NOTE(moritz): A: start, D: end
+	//B: control0
+	//C: control1
+	
+	Vector2 P0 = LerpM(A, t, B);
+	Vector2 P1 = LerpM(B, t, C);
+	Vector2 P2 = LerpM(C, t, D);
+	
+	Vector2 P01 = LerpM(P0, t, P1);
+	Vector2 P12 = LerpM(P1, t, P2);
+	
+	Vector2 P0112 = LerpM(P01, t, P12);
+	
+	return(P0112);
+}
+
+Vector2
+Bezier3(road_segment *RoadSegment, float t)
+{
+	return(Bezier3(RoadSegment->Start, RoadSegment->C0,
+				   RoadSegment->C1, RoadSegment->End, t));
+}
+
 void
-DrawRoad(float PlayerP, float MaxDistance, float fScreenWidth, float fScreenHeight, depth_line *DepthLines,
-		 int DepthLineCount, road_list *ActiveRoadList, float PlayerBaseXOffset)
+SetRoadSegmentDerivatives(road_segment *Segment)
 {
-	float fDepthLineCount = (float)DepthLineCount;
-	float BaseRoadHalfWidth = fScreenWidth*0.8f;
-	float BaseStripeHalfWidth = 20.0f;
+	//1st derivative (2nd degree) - Velocity
+	Segment->VStart = Segment->C0 - Segment->Start;
+	Segment->VC0    = Segment->C1 - Segment->C0;
+	Segment->VEnd   = Segment->End - Segment->C1;
+	
+	//2nd derivative (1st degree) - Acceleration
+	Segment->AStart = Segment->VC0 - Segment->VStart;
+	Segment->AEnd   = Segment->VEnd - Segment->VC0;
+}
+
+//NOTE(moritz): Velocity and acceleration of the curve at t, from the cached derivative control points
+inline Vector2
+RoadBezierVelocity(road_segment *Segment, float t)
+{
+	Vector2 Result = 3.0f*Bezier2(Segment->VStart, Segment->VC0, Segment->VEnd, t);
+	return(Result);
+}
+
+inline Vector2
+RoadBezierAcceleration(road_segment *Segment, float t)
+{
+	Vector2 Result = 6.0f*LerpM(Segment->AStart, t, Segment->AEnd);
+	return(Result);
+}
+
+//NOTE(moritz): dx/dy
+inline float
+RoadBezierSlope(road_segment *Segment, float t)
+{
+	Vector2 V = RoadBezierVelocity(Segment, t);
 	
-	float AngleOfRoad = PlayerBaseXOffset/fDepthLineCount;
+	float Result = 0.0f;
+	if(V.y != 0.0f)
+		Result = V.x/V.y;
 	
-	float Offset = PlayerP;
-	if(Offset > 8.0f)
-		Offset -= 8.0f;
+	return(Result);
+}
+
+//NOTE(moritz): d^2x/dy^2
+inline float
+RoadBezierCurvature(road_segment *Segment, float t)
+{
+	Vector2 V = RoadBezierVelocity(Segment, t);
+	Vector2 A = RoadBezierAcceleration(Segment, t);
 	
-	road_segment *CurrentSegment = ActiveRoadList->First;
-	float dX = 0.0f;
-	float fCurrentCenterOffsetX = 0.0f;
+	float Result = 0.0f;
+	if(V.y != 0.0f)
+		Result = (A.x*V.y - A.y*V.x)/(V.y*V.y*V.y);
 	
-	//int DepthSampleIndex = 0;
-	//TODO(moritz): This can be modified for hills...
-	//Horizon line needs to get adjusted as well
-	float DepthSampleIndex = 0.0f;
+	return(Result);
+}
+
+/*
+NOTE(moritz):
+Forward differencing for one cubic per lane: P(t) = A*t^3 + B*t^2 + C*t + D.
+After anchoring at t, every step to t + h is three adds (P += D1, D1 += D2, D2 += D3).
+Float error creeps in with every add, so the stepping gets re-anchored to the exact
+polynomial every so often.
+*/
+struct cubic_fd
+{
+	lane_f32 A;
+	lane_f32 B;
+	lane_f32 C;
+	lane_f32 D;
 	
-	for(int DepthLineIndex = 0;
-		DepthLineIndex < DepthLineCount;
-		++DepthLineIndex, DepthSampleIndex += 1.0f)
+	lane_f32 P;
+	lane_f32 D1;
+	lane_f32 D2;
+	lane_f32 D3;
+	
+	float h;
+};
+
+//NOTE(moritz): Power basis of a cubic Bezier from its control points
+void
+CubicFDInit(cubic_fd *FD, lane_f32 P0, lane_f32 P1, lane_f32 P2, lane_f32 P3, float h)
+{
+	lane_f32 Three = LaneF32(3.0f);
+	
+	lane_f32 P1x3 = LaneMul(Three, P1);
+	lane_f32 P2x3 = LaneMul(Three, P2);
+	
+	FD->A = LaneAdd(LaneSub(P1x3, P0), LaneSub(P3, P2x3));
+	FD->B = LaneMul(Three, LaneAdd(LaneSub(P0, LaneAdd(P1, P1)), P2));
+	FD->C = LaneMul(Three, LaneSub(P1, P0));
+	FD->D = P0;
+	FD->h = h;
+}
+
+inline lane_f32
+CubicFDEvaluate(cubic_fd *FD, float t)
+{
+	lane_f32 Lanet = LaneF32(t);
+	lane_f32 Result = LaneAdd(LaneMul(LaneAdd(LaneMul(LaneAdd(LaneMul(FD->A, Lanet), FD->B), Lanet), FD->C), Lanet), FD->D);
+	return(Result);
+}
+
+void
+CubicFDAnchor(cubic_fd *FD, float t)
+{
+	float h  = FD->h;
+	float h2 = h*h;
+	float h3 = h2*h;
+	
+	FD->P  = CubicFDEvaluate(FD, t);
+	FD->D1 = LaneAdd(LaneAdd(LaneMul(FD->A, LaneF32(3.0f*t*t*h + 3.0f*t*h2 + h3)),
+							 LaneMul(FD->B, LaneF32(2.0f*t*h + h2))),
+					 LaneMul(FD->C, LaneF32(h)));
+	FD->D2 = LaneAdd(LaneMul(FD->A, LaneF32(6.0f*t*h2 + 6.0f*h3)),
+					 LaneMul(FD->B, LaneF32(2.0f*h2)));
+	FD->D3 = LaneMul(FD->A, LaneF32(6.0f*h3));
+}
+
+inline void
+CubicFDStep(cubic_fd *FD)
+{
+	FD->P  = LaneAdd(FD->P,  FD->D1);
+	FD->D1 = LaneAdd(FD->D1, FD->D2);
+	FD->D2 = LaneAdd(FD->D2, FD->D3);
+}
+
+/*
+NOTE(moritz):
+Samples up to LANE_WIDTH road segments at a time, at StepCount + 1 uniform t values.
+Out needs SegmentCount*(StepCount + 1) entries, one run per segment.
+Returns the largest drift of the stepped x or y against the exact polynomial seen at a re-anchor.
+*/
+float
+SampleRoadSegmentsUniformT(road_segment **Segments, int SegmentCount, int StepCount, int AnchorInterval, Vector2 *Out)
+{
+	float MaxDrift = 0.0f;
+	float h = 1.0f/(float)StepCount;
+	int SampleCount = StepCount + 1;
+	
+	for(int BatchStart = 0;
+		BatchStart < SegmentCount;
+		BatchStart += LANE_WIDTH)
 	{
-		float fLineY = (float)DepthLineIndex;
-		
-		float fRoadWidth   = BaseRoadHalfWidth*DepthLines[(int)DepthSampleIndex/*DepthLineIndex*/].Scale/* + 20.0f*/;
-		float fStripeWidth = BaseStripeHalfWidth*DepthLines[(int)DepthSampleIndex/*DepthLineIndex*/].Scale;
-		
-		float fYLineNorm = fLineY/fDepthLineCount;
+		int BatchCount = SegmentCount - BatchStart;
+		if(BatchCount > LANE_WIDTH)
+			BatchCount = LANE_WIDTH;
 		
-		if(CurrentSegment->Next)
+		//NOTE(moritz): Gather control points into lanes. Unused lanes repeat the last segment.
+		float ControlX[4][LANE_WIDTH];
+		float ControlY[4][LANE_WIDTH];
+		for(int Lane = 0;
+			Lane < LANE_WIDTH;
+			++Lane)
 		{
-			if(fYLineNorm > CurrentSegment->Next->Position)
-				CurrentSegment = CurrentSegment->Next;
+			int LaneSegment = (Lane < BatchCount) ? Lane : (BatchCount - 1);
+			road_segment *Segment = Segments[BatchStart + LaneSegment];
+			
+			ControlX[0][Lane] = Segment->Start.x; ControlY[0][Lane] = Segment->Start.y;
+			ControlX[1][Lane] = Segment->C0.x;    ControlY[1][Lane] = Segment->C0.y;
+			ControlX[2][Lane] = Segment->C1.x;    ControlY[2][Lane] = Segment->C1.y;
+			ControlX[3][Lane] = Segment->End.x;   ControlY[3][Lane] = Segment->End.y;
 		}
 		
-		dX += CurrentSegment->ddX;
-		fCurrentCenterOffsetX += dX;
-		
-		//NOTE(moritz): Made up damping... Seems better
-		float CurveDamping = sinf(fYLineNorm*0.5f*Pi32);
-		CurveDamping = ClampM(0.0f, CurveDamping, 1.0f);
-		fCurrentCenterOffsetX *= CurveDamping;
-		
-		float SteerOffset = AngleOfRoad*(fDepthLineCount - fLineY);
-		
-		float fCurrentCenterX = 0.5f*fScreenWidth + fCurrentCenterOffsetX + SteerOffset;
-		
-		float RoadWorldZ = DepthLines[(int)DepthSampleIndex/*DepthLineIndex*/].Depth*MaxDistance + Offset;
-		
-		Color GrassColor = { 44,  78, 154, 255};
-		Color RoadColor  = { 15,   0,  30, 255};
+		cubic_fd FDX;
+		cubic_fd FDY;
+		CubicFDInit(&FDX, LaneLoad(ControlX[0]), LaneLoad(ControlX[1]), LaneLoad(ControlX[2]), LaneLoad(ControlX[3]), h);
+		CubicFDInit(&FDY, LaneLoad(ControlY[0]), LaneLoad(ControlY[1]), LaneLoad(ControlY[2]), LaneLoad(ControlY[3]), h);
+		CubicFDAnchor(&FDX, 0.0f);
+		CubicFDAnchor(&FDY, 0.0f);
 		
-		if(fmod(RoadWorldZ, 8.0f) > 4.0f)
+		for(int Step = 0;
+			Step < SampleCount;
+			++Step)
 		{
-			GrassColor = BLANK;
-			RoadColor  = { 30,  25,  40, 255};
+			if(Step && ((Step % AnchorInterval) == 0))
+			{
+				//NOTE(moritz): Drift check, then snap back onto the exact curve
+				float t = (float)Step*h;
+				
+				//NOTE(moritz): y counts as much as x, the LUT inverts y(t)
+				float SteppedX[LANE_WIDTH];
+				float ExactX[LANE_WIDTH];
+				float SteppedY[LANE_WIDTH];
+				float ExactY[LANE_WIDTH];
+				LaneStore(SteppedX, FDX.P);
+				LaneStore(ExactX, CubicFDEvaluate(&FDX, t));
+				LaneStore(SteppedY, FDY.P);
+				LaneStore(ExactY, CubicFDEvaluate(&FDY, t));
+				for(int Lane = 0;
+					Lane < BatchCount;
+					++Lane)
+				{
+					MaxDrift = Max(MaxDrift, fabsf(SteppedX[Lane] - ExactX[Lane]));
+					MaxDrift = Max(MaxDrift, fabsf(SteppedY[Lane] - ExactY[Lane]));
+				}
+				
+				CubicFDAnchor(&FDX, t);
+				CubicFDAnchor(&FDY, t);
+			}
+			
+			float X[LANE_WIDTH];
+			float Y[LANE_WIDTH];
+			LaneStore(X, FDX.P);
+			LaneStore(Y, FDY.P);
+			
+			for(int Lane = 0;
+				Lane < BatchCount;
+				++Lane)
+			{
+				Vector2 *Dest = Out + (BatchStart + Lane)*SampleCount + Step;
+				Dest->x = X[Lane];
+				Dest->y = Y[Lane];
+			}
+			
+			CubicFDStep(&FDX);
+			CubicFDStep(&FDY);
 		}
+	}
+	
+	return(MaxDrift);
+}
+
+/*
+NOTE(moritz):
+Resamples the curve at uniform y once, when the segment gets created.
+The curve gets forward differenced at dense uniform t first, then that polyline is
+walked once to find x and t at every uniform y (y is monotone in t).
+Depth lines are uniform in y as well, so a lookup is a direct index plus a lerp
+between neighbours, no search. Lerp error is bounded by max|d^2x/dy^2|*h^2/8 with
+h = 1/ROAD_LUT_SAMPLES.
+*/
+void
+ResampleRoadSegmentLUT(road_segment *Segment, Vector2 *Dense)
+{
+	float OneOverSampleCount = 1.0f/(float)ROAD_LUT_SAMPLES;
+	float OneOverDenseSteps  = 1.0f/(float)ROAD_LUT_DENSE_STEPS;
+	
+	int DenseIndex = 0;
+	for(int SampleIndex = 0;
+		SampleIndex <= ROAD_LUT_SAMPLES;
+		++SampleIndex)
+	{
+		float Y = (float)SampleIndex*OneOverSampleCount;
 		
-		//NOTE(moritz):Draw grass line first... draw road on top... 
-		Vector2 GrassStart = {0.0f, fScreenHeight - fLineY - 0.5f};
-		Vector2 GrassEnd   = {fScreenWidth, fScreenHeight - fLineY - 0.5f};
-		DrawLineV(GrassStart, GrassEnd, GrassColor);
+		while((DenseIndex < (ROAD_LUT_DENSE_STEPS - 1)) && (Dense[DenseIndex + 1].y < Y))
+			++DenseIndex;
 		
-		//NOTE(moritz): Draw road
-		Vector2 RoadStart = {fCurrentCenterX - fRoadWidth, fScreenHeight - fLineY - 0.5f};
-		Vector2 RoadEnd   = {fCurrentCenterX + fRoadWidth, fScreenHeight - fLineY - 0.5f};
+		Vector2 P0 = Dense[DenseIndex];
+		Vector2 P1 = Dense[DenseIndex + 1];
 		
-		//NOTE(moritz): Regular drawing
-		DrawLineV(RoadStart, RoadEnd, RoadColor);
+		float LerpT = 0.0f;
+		float DeltaY = P1.y - P0.y;
+		if(DeltaY > 0.0f)
+			LerpT = (Y - P0.y)/DeltaY;
+		LerpT = ClampM(0.0f, LerpT, 1.0f);
 		
-		//NOTE(moritz): Draw road stripes
-		if(fmod(RoadWorldZ + 0.5f, 2.0f) > 1.0f) //TODO(moritz): 0.5f -> is stripe offset
-		{
-			Vector2 StripeStart = {fCurrentCenterX - fStripeWidth, fScreenHeight - fLineY - 0.5f};
-			Vector2 StripeEnd   = {fCurrentCenterX + fStripeWidth, fScreenHeight - fLineY - 0.5f};
-			DrawLineV(StripeStart, StripeEnd, {235, 183,   0, 255});
-		}
+		Segment->LUTX[SampleIndex] = LerpM(P0.x, LerpT, P1.x);
+		Segment->LUTt[SampleIndex] = ((float)DenseIndex + LerpT)*OneOverDenseSteps;
 	}
+	
+	//NOTE(moritz): Snap the ends, so neighbouring segments meet exactly
+	Segment->LUTX[0] = Segment->Start.x;
+	Segment->LUTt[0] = 0.0f;
+	Segment->LUTX[ROAD_LUT_SAMPLES] = Segment->End.x;
+	Segment->LUTt[ROAD_LUT_SAMPLES] = 1.0f;
 }
 
-/*
-NOTE(moritz):
-Drawing billboards is kinda similiar to drawing the road itself, except for the first step.
-
-1. Find the depth line the billboard is on based on its distance.
-
-2. Do the accumulation up until that depth line to figure out where the road is and offset the billboard.
-(in the future this could be a single pass for all of the billboards so that the accumulation doesn't
-have to be done over and over again for each one)
-
-3. Throw in various lerps to make the billboard spawn and move smoothly...
-
-*/
+//NOTE(moritz): Dense samples of up to one lane batch of segments. Global, that's too much for the (web) stack
+global Vector2 RoadLUTDenseScratch[LANE_WIDTH*(ROAD_LUT_DENSE_STEPS + 1)];
 
-struct billboard
+//NOTE(moritz): Pass LANE_WIDTH segments at a time, so all lanes of the forward differencing are busy
+void
+SetRoadSegmentLUTs(road_segment **Segments, int SegmentCount)
 {
-	float SpriteScale;
-	float SpriteVerticalTweak;
-	
-	//Texture2D TextureRight;
-	//Texture2D TextureLeft;
-	Texture2D TextureRight;
-	Texture2D TextureLeft;
-};
+	for(int BatchStart = 0;
+		BatchStart < SegmentCount;
+		BatchStart += LANE_WIDTH)
+	{
+		int BatchCount = SegmentCount - BatchStart;
+		if(BatchCount > LANE_WIDTH)
+			BatchCount = LANE_WIDTH;
+		
+		float Drift = SampleRoadSegmentsUniformT(Segments + BatchStart, BatchCount, ROAD_LUT_DENSE_STEPS,
+												 ROAD_FD_ANCHOR_INTERVAL, RoadLUTDenseScratch);
+		
+#ifdef ROAD_LUT_VALIDATION
+		TraceLog(LOG_DEBUG, "ROAD: forward differencing drift %f (x in px, y in segment units), %d segments", Drift, BatchCount);
+#else
+		(void)Drift;
+#endif
+		
+		for(int SegmentIndex = 0;
+			SegmentIndex < BatchCount;
+			++SegmentIndex)
+		{
+			road_segment *Segment = Segments[BatchStart + SegmentIndex];
+			ResampleRoadSegmentLUT(Segment, RoadLUTDenseScratch + SegmentIndex*(ROAD_LUT_DENSE_STEPS + 1));
+			
+#ifdef ROAD_LUT_VALIDATION
+			float LUTError = RoadSegmentLUTError(Segment, 4096);
+			if(LUTError > ROAD_LUT_MAX_ERROR)
+				TraceLog(LOG_WARNING, "ROAD: LUT error %f px exceeds %f px", LUTError, ROAD_LUT_MAX_ERROR);
+			else
+				TraceLog(LOG_DEBUG, "ROAD: LUT error %f px", LUTError);
+#endif
+		}
+	}
+}
 
-struct thing
+//NOTE(moritz): x of the curve at segment y. Optionally returns the curve parameter t at that point.
+inline float
+RoadBezierLookUp(road_segment *Segment, float SegmentY, float *tOut = 0)
 {
-	int ID;
-	
-	bool IsDeleted;
-	bool IsAlien;
-	bool IsBullet;
+	float fIndex = ClampM(0.0f, SegmentY, 1.0f)*(float)ROAD_LUT_SAMPLES;
 	
-	float Distance;
-	float XOffset;
+	int Index = (int)fIndex;
+	if(Index > (ROAD_LUT_SAMPLES - 1))
+		Index = ROAD_LUT_SAMPLES - 1;
 	
-	float Speed;
+	float LerpT = fIndex - (float)Index;
 	
-	//NOTE(moritz): This one only for the alien
-	float ShootTimer; //in seconds
+	if(tOut)
+		*tOut = LerpM(Segment->LUTt[Index], LerpT, Segment->LUTt[Index + 1]);
 	
-	int BandIndex; //0: vehicles... 1: first band etc...
+	float Result = LerpM(Segment->LUTX[Index], LerpT, Segment->LUTX[Index + 1]);
+	return(Result);
+}
+
+//NOTE(moritz): Max x error of LUT lookups against dense evaluation of Bezier3
+float
+RoadSegmentLUTError(road_segment *Segment, int DenseSampleCount)
+{
+	float MaxError = 0.0f;
+	for(int SampleIndex = 0;
+		SampleIndex <= DenseSampleCount;
+		++SampleIndex)
+	{
+		float t = (float)SampleIndex/(float)DenseSampleCount;
+		Vector2 P = Bezier3(Segment, t);
+		
+		float Error = fabsf(RoadBezierLookUp(Segment, P.y) - P.x);
+		MaxError = Max(MaxError, Error);
+	}
 	
-	//NOTE(moritz): Only relevant for roadside decoration
-	float RoadSide; //NOTE(moritz): -1: left, 1: right.. 0: vehicle?
+	return(MaxError);
+}
+
+/*
+NOTE(moritz):
+Bezier segments are chained with matching tangents (C0 - Start == PrevEnd - PrevC1).
+The ddX preset of a segment determines the slope the road leaves the segment with:
+with the ddX model, a segment starting straight ends with dX = ddX*N pixels per line,
+which is ddX*N*N pixels per unit of segment y. A straight preset relaxes back to straight.
+C1.y gets jittered so y is not linear in t.
+*/
+void
+InitSegmentBezier(road_segment *Segment, road_segment *PrevSegment, unsigned int Roll, float MaxDistance)
+{
+	float EntrySlope = 0.0f;
+	Vector2 Start    = {0.0f, 0.0f};
+	float C0Y        = 1.0f/3.0f;
 	
-	Color Tint;
+	if(PrevSegment)
+	{
+		Vector2 PrevTangent = PrevSegment->End - PrevSegment->C1;
+		
+		Start.x    = PrevSegment->End.x;
+		C0Y        = PrevTangent.y;
+		EntrySlope = PrevTangent.x/PrevTangent.y;
+	}
 	
+	float ExitSlope = Segment->ddX*MaxDistance*MaxDistance;
+	float C1Y = 0.55f + 0.25f*((float)(UIntHash(Roll) & 0xFFFF)/65535.0f);
 	
-	//NOTE(moritz): Only relevant for the current frame
-	bool DrawMe;
+	Segment->Start = Start;
 	
-	//NOTE(moritz): Shooting
-	Vector2 FramePosition;
-	float   FrameScale;
+	Segment->C0.x = Start.x + C0Y*EntrySlope;
+	Segment->C0.y = C0Y;
 	
-	//NOTE(moritz): Collision
-	Vector2 FrameBaseP;
+	Segment->End.x = Start.x + 0.5f*(EntrySlope + ExitSlope);
+	Segment->End.y = 1.0f;
 	
-	billboard *Billboard;
+	Segment->C1.x = Segment->End.x - (1.0f - C1Y)*ExitSlope;
+	Segment->C1.y = C1Y;
 	
-	int NextIDInFreeList;
-};
+	SetRoadSegmentDerivatives(Segment);
+}
 
+//NOTE(moritz): Finds the segment covering the normalised screen line Y, starting the walk at Segment
+inline road_segment *
+FindRoadSegment(road_segment *Segment, float YLineNorm)
+{
+	while(Segment->Next && (YLineNorm >= Segment->Next->Position))
+		Segment = Segment->Next;
+	
+	return(Segment);
+}
 
+/*
+NOTE(moritz):
+Screen x of the road center for every depth line, for the selected road model.
+DrawRoad and the billboards read from this, so the accumulation only runs once per frame.
+*/
 void
-DetermineThingFrameProperties(billboard *Billboard, thing *Thing, float MaxDistance,
-							  float fScreenWidth, float fScreenHeight, depth_line *DepthLines, int DepthLineCount, 
-							  float CameraHeight, road_list *ActiveRoadList, float PlayerBaseXOffset, bool DebugText = false)
+ComputeRoadCenterX(road_model Model, float *RoadCenterX, int DepthLineCount, float fScreenWidth,
+				   road_list *ActiveRoadList, float PlayerBaseXOffset)
 {
 	float fDepthLineCount = (float)DepthLineCount;
-	float BaseRoadHalfWidth   = fScreenWidth*0.8f;
 	float AngleOfRoad = PlayerBaseXOffset/fDepthLineCount;
 	
-	if(Thing->IsDeleted)
-		return;
-	
-	Thing->DrawMe = true;
+	road_segment *CurrentSegment = ActiveRoadList->First;
 	
-	if(Thing->Distance > MaxDistance)
+	if(Model == RoadModel_ddX)
 	{
-		Thing->DrawMe = false;
-		return;
+		float dX = 0.0f;
+		float fCurrentCenterOffsetX = 0.0f;
+		
+		for(int DepthLineIndex = 0;
+			DepthLineIndex < DepthLineCount;
+			++DepthLineIndex)
+		{
+			float fLineY = (float)DepthLineIndex;
+			float fYLineNorm = fLineY/fDepthLineCount;
+			
+			if(CurrentSegment->Next)
+			{
+				if(fYLineNorm > CurrentSegment->Next->Position)
+					CurrentSegment = CurrentSegment->Next;
+			}
+			
+			dX += CurrentSegment->ddX;
+			fCurrentCenterOffsetX += dX;
+			
+			//NOTE(moritz): Made up damping... Seems better
+			float CurveDamping = sinf(fYLineNorm*0.5f*Pi32);
+			CurveDamping = ClampM(0.0f, CurveDamping, 1.0f);
+			fCurrentCenterOffsetX *= CurveDamping;
+			
+			float SteerOffset = AngleOfRoad*(fDepthLineCount - fLineY);
+			
+			RoadCenterX[DepthLineIndex] = 0.5f*fScreenWidth + fCurrentCenterOffsetX + SteerOffset;
+		}
+	}
+	else
+	{
+		//NOTE(moritz): The road always leaves the bottom of the screen straight ahead,
+		//so position and slope at the bottom line get subtracted.
+		float BaseT = 0.0f;
+		float BaseSegmentY = ClampM(0.0f, -CurrentSegment->Position, 1.0f);
+		float BaseX     = RoadBezierLookUp(CurrentSegment, BaseSegmentY, &BaseT);
+		float BaseSlope = RoadBezierSlope(CurrentSegment, BaseT);
+		
+		for(int DepthLineIndex = 0;
+			DepthLineIndex < DepthLineCount;
+			++DepthLineIndex)
+		{
+			float fLineY = (float)DepthLineIndex;
+			float fYLineNorm = fLineY/fDepthLineCount;
+			
+			CurrentSegment = FindRoadSegment(CurrentSegment, fYLineNorm);
+			
+			float SegmentY = ClampM(0.0f, fYLineNorm - CurrentSegment->Position, 1.0f);
+			float X = RoadBezierLookUp(CurrentSegment, SegmentY);
+			
+			float fCurrentCenterOffsetX = X - BaseX - BaseSlope*fYLineNorm;
+			
+			float SteerOffset = AngleOfRoad*(fDepthLineCount - fLineY);
+			
+			RoadCenterX[DepthLineIndex] = 0.5f*fScreenWidth + fCurrentCenterOffsetX + SteerOffset;
+		}
+	}
+}
+
+//NOTE(moritz): Strongest curve any ddX preset produces, in pixels per depth line squared
+float
+MaxRoadPresetCurvature(void)
+{
+	float Result = 0.0f;
+	for(int PresetIndex = 0;
+		PresetIndex < (int)ArrayCount(RoadPresets);
+		++PresetIndex)
+	{
+		Result = Max(Result, fabsf(RoadPresets[PresetIndex]));
 	}
 	
-	//NOTE(moirtz): Test for "scaling in" distant billboards instead of popping them in...
-	//float ScaleInDistance = 10.0f;
-	float OneOverScaleInDistance = 0.1f;
-	float ScaleInT = (MaxDistance - Thing->Distance)*OneOverScaleInDistance;
-	ScaleInT = Clamp(0.0f, ScaleInT, 1.0f);
+	return(Result);
+}
+
+/*
+NOTE(moritz):
+Curvature of the visible road per depth line (in ddX units: pixels per depth line squared),
+plus a prefix sum over it and the next line where the bend changes direction.
+Rebuilt once per frame, so windowed averages and inflection lookups are O(1) for
+the player physics as well as anything else driving on the road.
+*/
+struct road_curvature
+{
+	int LineCount;
+	float MaxDistance;
+	float CameraHeight;
 	
-	//if(DebugText)
-	//DrawText(TextFormat("TreeScaleInT: %f", ScaleInT), 20, 20, 10, RED);
+	float *Curvature;      //NOTE(moritz): LineCount entries
+	float *CurvatureSum;   //NOTE(moritz): LineCount + 1 entries, CurvatureSum[I] = sum of Curvature[0..I-1]
+	int   *NextInflection; //NOTE(moritz): First line above with a different curvature sign, LineCount if none
+};
+
+void
+AllocateRoadCurvature(road_curvature *Curvature, int DepthLineCount, float MaxDistance, float CameraHeight)
+{
+	Curvature->LineCount    = DepthLineCount;
+	Curvature->MaxDistance  = MaxDistance;
+	Curvature->CameraHeight = CameraHeight;
 	
-	float OneOverMaxDistance = 1.0f/MaxDistance;
-	float BasePDepth = Thing->Distance*OneOverMaxDistance;
+	Curvature->Curvature      = (float *)malloc(sizeof(float)*DepthLineCount);
+	Curvature->CurvatureSum   = (float *)malloc(sizeof(float)*(DepthLineCount + 1));
+	Curvature->NextInflection = (int *)malloc(sizeof(int)*DepthLineCount);
 	
-	//NOTE(moritz): Go through Depthlines (back to front) and find the first one with equal or smaller depth
-	int BasePDepthLineIndex = -1;
+	ZeroSize(Curvature->Curvature, sizeof(float)*DepthLineCount);
+	ZeroSize(Curvature->CurvatureSum, sizeof(float)*(DepthLineCount + 1));
+	ZeroSize(Curvature->NextInflection, sizeof(int)*DepthLineCount);
+}
+
+//NOTE(moritz): Curvature doesn't depend on steering (that is a linear offset), so this can run before the player update
+void
+ComputeRoadCurvature(road_model Model, road_curvature *Curvature, road_list *ActiveRoadList)
+{
+	int DepthLineCount = Curvature->LineCount;
+	float fDepthLineCount = (float)DepthLineCount;
+	float OneOverLineCountSq = 1.0f/(fDepthLineCount*fDepthLineCount);
+	float MaxCurvature = MaxRoadPresetCurvature();
+	
+	road_segment *CurrentSegment = ActiveRoadList->First;
+	
+	for(int DepthLineIndex = 0;
+		DepthLineIndex < DepthLineCount;
+		++DepthLineIndex)
+	{
+		float fYLineNorm = (float)DepthLineIndex/fDepthLineCount;
+		
+		float LineCurvature = 0.0f;
+		if(Model == RoadModel_ddX)
+		{
+			if(CurrentSegment->Next)
+			{
+				if(fYLineNorm > CurrentSegment->Next->Position)
+					CurrentSegment = CurrentSegment->Next;
+			}
+			
+			LineCurvature = CurrentSegment->ddX;
+		}
+		else
+		{
+			CurrentSegment = FindRoadSegment(CurrentSegment, fYLineNorm);
+			
+			float t = 0.0f;
+			RoadBezierLookUp(CurrentSegment, fYLineNorm - CurrentSegment->Position, &t);
+			
+			//NOTE(moritz): Curvature peaks near the segment ends can be a lot sharper than any preset.
+			//Don't let the Bezier road pull harder than the strongest ddX preset.
+			LineCurvature = RoadBezierCurvature(CurrentSegment, t)*OneOverLineCountSq;
+			LineCurvature = ClampM(-MaxCurvature, LineCurvature, MaxCurvature);
+		}
+		
+		Curvature->Curvature[DepthLineIndex] = LineCurvature;
+		Curvature->CurvatureSum[DepthLineIndex + 1] = Curvature->CurvatureSum[DepthLineIndex] + LineCurvature;
+	}
+	
+	int NextInflection = DepthLineCount;
 	for(int DepthLineIndex = (DepthLineCount - 1);
 		DepthLineIndex >= 0;
 		--DepthLineIndex)
 	{
-		if(DepthLines[DepthLineIndex].Depth <= BasePDepth)
+		Curvature->NextInflection[DepthLineIndex] = NextInflection;
+		
+		if(DepthLineIndex &&
+		   (Sign(Curvature->Curvature[DepthLineIndex]) != Sign(Curvature->Curvature[DepthLineIndex - 1])))
 		{
-			BasePDepthLineIndex = DepthLineIndex;
-			break;
+			NextInflection = DepthLineIndex;
 		}
 	}
+}
+
+//NOTE(moritz): Fractional depth line for a distance ahead of the player (inverse of the depth map)
+inline float
+RoadLineAtDistance(road_curvature *Curvature, float Distance)
+{
+	float fLineCount = (float)Curvature->LineCount;
 	
-	if(BasePDepthLineIndex == -1)
+	float Result = 0.0f;
+	if(Distance > 0.0f)
+		Result = fLineCount - Curvature->CameraHeight*Curvature->MaxDistance/Distance;
+	
+	Result = ClampM(0.0f, Result, fLineCount);
+	return(Result);
+}
+
+inline float
+RoadDistanceAtLine(road_curvature *Curvature, float Line)
+{
+	float Result = F32Max;
+	float LinesLeft = (float)Curvature->LineCount - Line;
+	if(LinesLeft > 0.0f)
+		Result = Curvature->CameraHeight*Curvature->MaxDistance/LinesLeft;
+	
+	return(Result);
+}
+
+inline float
+RoadCurvatureSumAt(road_curvature *Curvature, float Line)
+{
+	int LineIndex = (int)Line;
+	if(LineIndex >= Curvature->LineCount)
+		return(Curvature->CurvatureSum[Curvature->LineCount]);
+	
+	float Result = Curvature->CurvatureSum[LineIndex] + (Line - (float)LineIndex)*Curvature->Curvature[LineIndex];
+	return(Result);
+}
+
+//NOTE(moritz): Average curvature of the road between Distance and Distance + Window
+float
+RoadCurvatureAt(road_curvature *Curvature, float Distance, float Window)
+{
+	float Line0 = RoadLineAtDistance(Curvature, Distance);
+	float Line1 = RoadLineAtDistance(Curvature, Distance + Window);
+	
+	float Result = 0.0f;
+	if((Line1 - Line0) > 0.001f)
 	{
-		Thing->DrawMe = false;
-		return;
+		Result = (RoadCurvatureSumAt(Curvature, Line1) - RoadCurvatureSumAt(Curvature, Line0))/(Line1 - Line0);
+	}
+	else
+	{
+		int LineIndex = (int)Line0;
+		if(LineIndex > (Curvature->LineCount - 1))
+			LineIndex = Curvature->LineCount - 1;
+		
+		Result = Curvature->Curvature[LineIndex];
 	}
 	
-	//NOTE(moritz): Lerp the sprite scaling between the base depth line and the next closer one. 
-	//Use depth to determine t.
-	//TODO(moritz): Handle out of bounds!
-	float Depth0 = DepthLines[BasePDepthLineIndex].Depth;
-	float Depth1 = DepthLines[BasePDepthLineIndex + 1].Depth;
+	return(Result);
+}
+
+//NOTE(moritz): Distance at which the bend at Distance changes direction, F32Max if that's not on screen
+float
+RoadNextInflection(road_curvature *Curvature, float Distance)
+{
+	int LineIndex = (int)RoadLineAtDistance(Curvature, Distance);
+	if(LineIndex > (Curvature->LineCount - 1))
+		return(F32Max);
 	
-	float DeltaDepth = Depth1     - Depth0;
-	float BasePDelta = BasePDepth - Depth0;
+	int InflectionLine = Curvature->NextInflection[LineIndex];
 	
-	float t = BasePDelta/DeltaDepth;
+	float Result = F32Max;
+	if(InflectionLine < Curvature->LineCount)
+		Result = RoadDistanceAtLine(Curvature, (float)InflectionLine);
 	
-	//TODO(moritz): Handle out of bounds!
-	float Scale0 = DepthLines[BasePDepthLineIndex].Scale;
-	float Scale1 = DepthLines[BasePDepthLineIndex + 1].Scale;
+	return(Result);
+}
+
+struct road_benchmark
+{
+	int Iterations;
+	double SecondsPerPass[RoadModel_Count];
+};
+
+//NOTE(moritz): Runs the per frame road pass of every model back to back on the same road
+void
+BenchmarkRoadModels(road_benchmark *Benchmark, float *RoadCenterX, int DepthLineCount, float fScreenWidth,
+					road_list *ActiveRoadList, float PlayerBaseXOffset)
+{
+	int Iterations = 2000;
+	Benchmark->Iterations = Iterations;
 	
-	float DepthScale = LerpM(Scale0, t, Scale1);
+	for(int ModelIndex = 0;
+		ModelIndex < RoadModel_Count;
+		++ModelIndex)
+	{
+		double StartTime = GetTime();
+		for(int Iteration = 0;
+			Iteration < Iterations;
+			++Iteration)
+		{
+			ComputeRoadCenterX((road_model)ModelIndex, RoadCenterX, DepthLineCount, fScreenWidth,
+							   ActiveRoadList, PlayerBaseXOffset);
+		}
+		double EndTime = GetTime();
+		
+		Benchmark->SecondsPerPass[ModelIndex] = (EndTime - StartTime)/(double)Iterations;
+		
+		TraceLog(LOG_INFO, "ROAD: %s model: %.3f us per pass (%d lines)",
+				 RoadModelNames[ModelIndex], 1000000.0*Benchmark->SecondsPerPass[ModelIndex], DepthLineCount);
+	}
+}
+
+//NOTE(moritz): Per frame instrumentation. Toggle the overlay with F1.
+//NOTE(moritz): Band 0 is everything on the road (cars, aliens, bullets), the rest are the scenery bands
+#define THING_BAND_COUNT 5
+
+struct frame_stats
+{
+	//NOTE(moritz): Road pass fill rate in pixels. "Layered" is what the old
+	//gradient + grass + road + stripe stacking would have touched for the same frame.
+	int RoadPixels;
+	int RoadPixelsLayered;
+	
+	//NOTE(moritz): Same for the background (sky, horizon, sunset, skyline), "Layered" is drawing
+	//every layer on its own each frame instead of the cached sky/horizon and the one skyline pass
+	int BackgroundPixels;
+	int BackgroundPixelsLayered;
+	
+	double RoadPassSeconds;
+	road_model RoadModel;
+	
+	float PlayerCurvature;
+	float NextInflectionDistance;
+	
+	int CollisionCandidates;
+	int CollisionCandidatesDropped;
+	int CollisionHits;
+	float CollisionTOI; //NOTE(moritz): Earliest hit this tick, as a fraction of the tick
+	
+	int BandDrawn[THING_BAND_COUNT];
+	int BandImpostors[THING_BAND_COUNT];
+	int BandCulled[THING_BAND_COUNT];
+	
+	int ThingCount;
+	int SceneryCount;
+	int ThingBlockCount;
+	int ThingOverflowCount;
+	int AlienCount;
+	int BulletCount;
+	int RefusedSpawnCount;
+	
+	//NOTE(moritz): Event to mixer plus one callback buffer, so roughly until it's audible
+	float AudioLatencyLast;
+	float AudioLatencyMax;
+	int AudioCommandsDropped;
+	
+	int SfxVoicesActive;
+	int SfxVoiceCount;
+	int SfxVoicesStolen;
+	int SfxPlaysRejected;
+	int SfxPlaysCapped;
+	
+	int MusicPrefetchBlocks;
+	int MusicBufferedBlocks;
+	int MusicUnderruns;
+	float MusicDecodeSpeed;
+};
+
+global frame_stats FrameStats;
+
+//NOTE(moritz): CPU time per frame from the top of the main loop up to presenting, without waiting on vsync
+#define FRAME_TIME_HISTORY_COUNT 120
+
+struct frame_time_history
+{
+	float Seconds[FRAME_TIME_HISTORY_COUNT];
+	int Next;
+	int Count;
+};
+
+global frame_time_history FrameTimeHistory;
+
+void
+RecordFrameTime(float Seconds)
+{
+	FrameTimeHistory.Seconds[FrameTimeHistory.Next] = Seconds;
+	FrameTimeHistory.Next = (FrameTimeHistory.Next + 1) % FRAME_TIME_HISTORY_COUNT;
+	if(FrameTimeHistory.Count < FRAME_TIME_HISTORY_COUNT)
+		++FrameTimeHistory.Count;
+}
+
+void
+SummarizeFrameTimes(float *AverageSeconds, float *MaxSeconds)
+{
+	float Sum = 0.0f;
+	float MaxSoFar = 0.0f;
+	for(int Index = 0;
+		Index < FrameTimeHistory.Count;
+		++Index)
+	{
+		Sum += FrameTimeHistory.Seconds[Index];
+		MaxSoFar = Max(MaxSoFar, FrameTimeHistory.Seconds[Index]);
+	}
 	
-	//if(DebugText)
-	//DrawText(TextFormat("TreeDepthScale: %f", DepthScale), 20, 30, 10, RED);
+	*AverageSeconds = FrameTimeHistory.Count ? Sum/(float)FrameTimeHistory.Count : 0.0f;
+	*MaxSeconds = MaxSoFar;
+}
+
+inline int
+SpanPixelCount(float X0, float X1)
+{
+	int Result = (int)(X1 + 0.5f) - (int)(X0 + 0.5f);
+	return(Result);
+}
+
+//NOTE(moritz): Pixels a rectangle covers on screen
+inline int
+RectPixelCount(Rectangle Rect, float fScreenWidth, float fScreenHeight)
+{
+	float X0 = ClampM(0.0f, Rect.x, fScreenWidth);
+	float X1 = ClampM(0.0f, Rect.x + Rect.width, fScreenWidth);
+	float Y0 = ClampM(0.0f, Rect.y, fScreenHeight);
+	float Y1 = ClampM(0.0f, Rect.y + Rect.height, fScreenHeight);
 	
-	//NOTE(moritz): Determine screen position of BaseP
-	float BasePScreenY = fScreenHeight;
-	if(BasePDepth != 0.0f)
-		BasePScreenY = (float)DepthLineCount + (CameraHeight/BasePDepth);
+	int Result = SpanPixelCount(X0, X1)*SpanPixelCount(Y0, Y1);
+	return(Result);
+}
+
+//NOTE(moritz): Emits one horizontal span of a road line. X0/X1 are expected to be clipped
+//to the screen already, so neighbouring spans of a line never touch the same pixel.
+inline void
+EmitRoadSpan(float X0, float X1, float Y, Color SpanColor)
+{
+	if((X1 <= X0) || (SpanColor.a == 0))
+		return;
+	
+	Vector2 SpanStart = {X0, Y};
+	Vector2 SpanEnd   = {X1, Y};
+	DrawLineV(SpanStart, SpanEnd, SpanColor);
+	
+	FrameStats.RoadPixels += SpanPixelCount(X0, X1);
+}
+
+void
+DrawFrameStats(int X, int Y, road_benchmark *RoadBenchmark)
+{
+	int FontSize   = 10;
+	int LineHeight = 12;
+	
+	float RoadSaving = 0.0f;
+	if(FrameStats.RoadPixelsLayered)
+		RoadSaving = 1.0f - (float)FrameStats.RoadPixels/(float)FrameStats.RoadPixelsLayered;
+	
+	float BackgroundSaving = 0.0f;
+	if(FrameStats.BackgroundPixelsLayered)
+		BackgroundSaving = 1.0f - (float)FrameStats.BackgroundPixels/(float)FrameStats.BackgroundPixelsLayered;
+	
+	DrawText(TextFormat("FPS: %d", GetFPS()), X, Y, FontSize, RED);
+	Y += LineHeight;
+	DrawText(TextFormat("Road fill: %d px (layered %d px, -%.0f%%)",
+						FrameStats.RoadPixels, FrameStats.RoadPixelsLayered, 100.0f*RoadSaving), X, Y, FontSize, RED);
+	Y += LineHeight;
+	DrawText(TextFormat("Background fill: %d px (layered %d px, -%.0f%%)",
+						FrameStats.BackgroundPixels, FrameStats.BackgroundPixelsLayered, 100.0f*BackgroundSaving), X, Y, FontSize, RED);
+	Y += LineHeight;
+	DrawText(TextFormat("Road model (F2): %s, %.1f us", RoadModelNames[FrameStats.RoadModel],
+						1000000.0*FrameStats.RoadPassSeconds), X, Y, FontSize, RED);
+	Y += LineHeight;
+	if(RoadBenchmark->Iterations)
+	{
+		DrawText(TextFormat("Road bench (F3): ddX %.2f us, Bezier %.2f us",
+							1000000.0*RoadBenchmark->SecondsPerPass[RoadModel_ddX],
+							1000000.0*RoadBenchmark->SecondsPerPass[RoadModel_Bezier]), X, Y, FontSize, RED);
+		Y += LineHeight;
+	}
+	if(FrameStats.CollisionHits)
+		DrawText(TextFormat("Collision candidates: %d, hits: %d at t = %.2f", FrameStats.CollisionCandidates,
+							FrameStats.CollisionHits, FrameStats.CollisionTOI), X, Y, FontSize, RED);
+	else
+		DrawText(TextFormat("Collision candidates: %d", FrameStats.CollisionCandidates), X, Y, FontSize, RED);
+	Y += LineHeight;
+	if(FrameStats.CollisionCandidatesDropped)
+	{
+		DrawText(TextFormat("Collision candidates dropped: %d", FrameStats.CollisionCandidatesDropped), X, Y, FontSize, RED);
+		Y += LineHeight;
+	}
+	if(FrameStats.NextInflectionDistance < F32Max)
+		DrawText(TextFormat("Curvature: %.4f, bend changes at %.1f", FrameStats.PlayerCurvature,
+							FrameStats.NextInflectionDistance), X, Y, FontSize, RED);
+	else
+		DrawText(TextFormat("Curvature: %.4f", FrameStats.PlayerCurvature), X, Y, FontSize, RED);
+	Y += LineHeight;
+	DrawText(TextFormat("Things: %d in %d blocks (%d overflowed), scenery: %d, aliens: %d, bullets: %d, refused spawns: %d (stress F4)",
+						FrameStats.ThingCount, FrameStats.ThingBlockCount, FrameStats.ThingOverflowCount, FrameStats.SceneryCount,
+						FrameStats.AlienCount, FrameStats.BulletCount, FrameStats.RefusedSpawnCount), X, Y, FontSize, RED);
+	Y += LineHeight;
+	float AverageSeconds, MaxSeconds;
+	SummarizeFrameTimes(&AverageSeconds, &MaxSeconds);
+	DrawText(TextFormat("Frame work: avg %.2f ms, max %.2f ms", 1000.0f*AverageSeconds, 1000.0f*MaxSeconds),
+			 X, Y, FontSize, RED);
+	Y += LineHeight;
+	DrawText(TextFormat("Audio latency: %.1f ms, max %.1f ms, %d commands dropped", 1000.0f*FrameStats.AudioLatencyLast,
+						1000.0f*FrameStats.AudioLatencyMax, FrameStats.AudioCommandsDropped), X, Y, FontSize, RED);
+	Y += LineHeight;
+	DrawText(TextFormat("Sfx voices: %d/%d, %d stolen, %d rejected, %d capped", FrameStats.SfxVoicesActive, FrameStats.SfxVoiceCount,
+						FrameStats.SfxVoicesStolen, FrameStats.SfxPlaysRejected, FrameStats.SfxPlaysCapped), X, Y, FontSize, RED);
+	Y += LineHeight;
+	DrawText(TextFormat("Music: %d/%d blocks buffered, decode %.0fx realtime, %d underruns", FrameStats.MusicBufferedBlocks,
+						FrameStats.MusicPrefetchBlocks, FrameStats.MusicDecodeSpeed, FrameStats.MusicUnderruns), X, Y, FontSize, RED);
+	Y += LineHeight;
+	for(int BandIndex = 0;
+		BandIndex < THING_BAND_COUNT;
+		++BandIndex)
+	{
+		DrawText(TextFormat("Band %d: %d drawn, %d impostors, %d culled", BandIndex,
+							FrameStats.BandDrawn[BandIndex], FrameStats.BandImpostors[BandIndex],
+							FrameStats.BandCulled[BandIndex]), X, Y, FontSize, RED);
+		Y += LineHeight;
+	}
+}
+
+/*
+NOTE(moritz):
+The road is rasterized as disjoint spans per depth line:
+
+grass-left | road | stripe | road | grass-right
+
+Every ground pixel gets written exactly once. On the bands where the grass used to be
+BLANK (letting the ground gradient shine through) the grass spans get the gradient color
+of that line instead, so the full screen ground gradient doesn't need to be drawn anymore.
+*/
+void
+DrawRoad(float PlayerP, float MaxDistance, float fScreenWidth, float fScreenHeight, depth_line *DepthLines,
+		 int DepthLineCount, float *RoadCenterX, Color GrassGradientCol0, Color GrassGradientCol1)
+{
+	float fDepthLineCount = (float)DepthLineCount;
+	float BaseRoadHalfWidth = fScreenWidth*0.8f;
+	float BaseStripeHalfWidth = 20.0f;
+	
+	float Offset = PlayerP;
+	if(Offset > 8.0f)
+		Offset -= 8.0f;
+	
+	//int DepthSampleIndex = 0;
+	//TODO(moritz): This can be modified for hills...
+	//Horizon line needs to get adjusted as well
+	float DepthSampleIndex = 0.0f;
+	
+	float GroundTop    = fScreenHeight - fDepthLineCount;
+	float OneOverGroundHeight = 1.0f/fDepthLineCount;
+	
+	for(int DepthLineIndex = 0;
+		DepthLineIndex < DepthLineCount;
+		++DepthLineIndex, DepthSampleIndex += 1.0f)
+	{
+		float fLineY = (float)DepthLineIndex;
+		
+		float fRoadWidth   = BaseRoadHalfWidth*DepthLines[(int)DepthSampleIndex/*DepthLineIndex*/].Scale/* + 20.0f*/;
+		float fStripeWidth = BaseStripeHalfWidth*DepthLines[(int)DepthSampleIndex/*DepthLineIndex*/].Scale;
+		
+		float fCurrentCenterX = RoadCenterX[DepthLineIndex];
+		
+		float RoadWorldZ = DepthLines[(int)DepthSampleIndex/*DepthLineIndex*/].Depth*MaxDistance + Offset;
+		
+		float ScreenY = fScreenHeight - fLineY - 0.5f;
+		
+		Color GrassColor = { 44,  78, 154, 255};
+		Color RoadColor  = { 15,   0,  30, 255};
+		Color StripeColor = {235, 183,   0, 255};
+		
+		if(fmod(RoadWorldZ, 8.0f) > 4.0f)
+		{
+			float GradientT = (ScreenY - GroundTop)*OneOverGroundHeight;
+			GrassColor = LerpM(GrassGradientCol0, GradientT, GrassGradientCol1);
+			RoadColor  = { 30,  25,  40, 255};
+		}
+		
+		bool DrawStripe = (fmod(RoadWorldZ + 0.5f, 2.0f) > 1.0f); //TODO(moritz): 0.5f -> is stripe offset
+		
+		//NOTE(moritz): Span boundaries, left to right. Clamping keeps them ordered and on screen.
+		float RoadLeft    = ClampM(0.0f, fCurrentCenterX - fRoadWidth,   fScreenWidth);
+		float RoadRight   = ClampM(0.0f, fCurrentCenterX + fRoadWidth,   fScreenWidth);
+		float StripeLeft  = ClampM(RoadLeft, fCurrentCenterX - fStripeWidth, RoadRight);
+		float StripeRight = ClampM(RoadLeft, fCurrentCenterX + fStripeWidth, RoadRight);
+		
+		EmitRoadSpan(0.0f, RoadLeft, ScreenY, GrassColor);
+		
+		if(DrawStripe)
+		{
+			EmitRoadSpan(RoadLeft,    StripeLeft,  ScreenY, RoadColor);
+			EmitRoadSpan(StripeLeft,  StripeRight, ScreenY, StripeColor);
+			EmitRoadSpan(StripeRight, RoadRight,   ScreenY, RoadColor);
+		}
+		else
+		{
+			EmitRoadSpan(RoadLeft, RoadRight, ScreenY, RoadColor);
+		}
+		
+		EmitRoadSpan(RoadRight, fScreenWidth, ScreenY, GrassColor);
+		
+		//NOTE(moritz): Reference count for the old layered drawing:
+		//ground gradient row + full width grass line + road line + stripe line
+		FrameStats.RoadPixelsLayered += 2*SpanPixelCount(0.0f, fScreenWidth) + SpanPixelCount(RoadLeft, RoadRight);
+		if(DrawStripe)
+			FrameStats.RoadPixelsLayered += SpanPixelCount(StripeLeft, StripeRight);
+	}
+}
+
+/*
+NOTE(moritz):
+Drawing billboards is kinda similiar to drawing the road itself, except for the first step.
+
+1. Find the depth line the billboard is on based on its distance.
+
+2. Do the accumulation up until that depth line to figure out where the road is and offset the billboard.
+(in the future this could be a single pass for all of the billboards so that the accumulation doesn't
+have to be done over and over again for each one)
+
+3. Throw in various lerps to make the billboard spawn and move smoothly...
+
+*/
+
+struct billboard
+{
+	float SpriteScale;
+	float SpriteVerticalTweak;
+	
+	//Texture2D TextureRight;
+	//Texture2D TextureLeft;
+	Texture2D TextureRight;
+	Texture2D TextureLeft;
+	
+	//NOTE(moritz): Only set for billboards that can be clicked on
+	struct alpha_mask *PickMask;
+	
+	//NOTE(moritz): Average color of the sprite, alpha is how much of it is covered.
+	//Drawn as a plain rect once the sprite is only a few pixels tall.
+	Color ImpostorColor;
+};
+
+/* NOTE(moritz):
+All the pngs, wavs and baked mips get packed into assets.pak at build time by code/pack_assets.py,
+pngs and wavs already decoded. On native builds the pack gets mmapped and raylib is handed slices
+of it, so there is no per file open or png decode at startup. Web (and windows for now) read the
+whole pack with one LoadFileData instead.
+
+The web pack is built with --deflate: decoded pixels are big to download and to keep in the heap,
+so entries that shrink get stored deflated and are inflated one at a time while loading
+(Params[ASSET_PACK_INFLATED_SIZE] is their inflated size, 0 for stored entries).
+
+Without a pack everything is loaded from the loose files like before.
+*/
+
+#define ASSET_PACK_MAGIC 0x4b504653 //NOTE(moritz): 'SFPK'
+#define ASSET_PACK_VERSION 2
+#define ASSET_PACK_NAME_SIZE 48
+#define ASSET_PACK_INFLATED_SIZE 4
+
+enum asset_type
+{
+	AssetType_Raw,
+	AssetType_Image,
+	AssetType_Sound,
+};
+
+struct asset_pack_header
+{
+	unsigned int Magic;
+	unsigned int Version;
+	unsigned int EntryCount;
+	unsigned int Pad;
+};
+
+struct asset_pack_entry
+{
+	char Name[ASSET_PACK_NAME_SIZE];
+	unsigned int Type;
+	unsigned int Offset;
+	unsigned int Size;
+	
+	//NOTE(moritz): Images: width, height
+	//Sounds: frame count, sample rate, sample size, channels
+	//All: inflated size in the last one when deflated
+	int Params[5];
+};
+
+struct asset_pack
+{
+	unsigned char *Memory;
+	unsigned int Size;
+	bool IsMapped;
+	
+	asset_pack_entry *Entries;
+	int EntryCount;
+};
+
+global asset_pack AssetPack;
+
+void
+CloseAssetPack(asset_pack *Pack)
+{
+	if(Pack->Memory)
+	{
+#ifdef ASSET_PACK_MMAP
+		if(Pack->IsMapped)
+			munmap(Pack->Memory, Pack->Size);
+		else
+#endif
+			UnloadFileData(Pack->Memory);
+	}
+	
+	*Pack = {};
+}
+
+bool
+OpenAssetPack(asset_pack *Pack, const char *FileName)
+{
+	*Pack = {};
+	
+#ifdef ASSET_PACK_MMAP
+	//NOTE(moritz): stdio instead of unistd.h, that one declares a link() which clashes with our link
+	FILE *File = fopen(FileName, "rb");
+	if(File)
+	{
+		struct stat FileStat;
+		if((fstat(fileno(File), &FileStat) == 0) && (FileStat.st_size > 0))
+		{
+			void *Mapped = mmap(0, FileStat.st_size, PROT_READ, MAP_PRIVATE, fileno(File), 0);
+			if(Mapped != MAP_FAILED)
+			{
+				Pack->Memory   = (unsigned char *)Mapped;
+				Pack->Size     = (unsigned int)FileStat.st_size;
+				Pack->IsMapped = true;
+			}
+		}
+		
+		//NOTE(moritz): The mapping stays valid after closing the file
+		fclose(File);
+	}
+#else
+	if(FileExists(FileName))
+		Pack->Memory = LoadFileData(FileName, &Pack->Size);
+#endif
+	
+	if(!Pack->Memory)
+		return(false);
+	
+	asset_pack_header *Header = (asset_pack_header *)Pack->Memory;
+	bool IsValid = ((Pack->Size >= sizeof(asset_pack_header)) &&
+					(Header->Magic == ASSET_PACK_MAGIC) && (Header->Version == ASSET_PACK_VERSION) &&
+					((Pack->Size - sizeof(asset_pack_header))/sizeof(asset_pack_entry) >= Header->EntryCount));
+	
+	if(IsValid)
+	{
+		Pack->Entries    = (asset_pack_entry *)(Pack->Memory + sizeof(asset_pack_header));
+		Pack->EntryCount = (int)Header->EntryCount;
+		
+		for(int EntryIndex = 0;
+			EntryIndex < Pack->EntryCount;
+			++EntryIndex)
+		{
+			asset_pack_entry *Entry = Pack->Entries + EntryIndex;
+			if((Entry->Offset > Pack->Size) || (Entry->Size > (Pack->Size - Entry->Offset)) ||
+			   (Entry->Name[ASSET_PACK_NAME_SIZE - 1] != 0))
+			{
+				IsValid = false;
+				break;
+			}
+		}
+	}
+	
+	if(!IsValid)
+	{
+		TraceLog(LOG_WARNING, "Asset pack %s is broken, loading loose files instead", FileName);
+		CloseAssetPack(Pack);
+	}
+	
+	return(IsValid);
+}
+
+asset_pack_entry *
+FindAsset(asset_pack *Pack, const char *Name, asset_type Type)
+{
+	for(int EntryIndex = 0;
+		EntryIndex < Pack->EntryCount;
+		++EntryIndex)
+	{
+		asset_pack_entry *Entry = Pack->Entries + EntryIndex;
+		if((Entry->Type == (unsigned int)Type) && (strcmp(Entry->Name, Name) == 0))
+			return(Entry);
+	}
+	
+	return(0);
+}
+
+/*
+NOTE(moritz):
+Stored entries point right into the pack. Deflated ones get inflated into memory the caller
+owns (*IsOwned gets set), that gets freed with MemFree/UnloadFileData.
+Returns 0 when the entry doesn't inflate (or this build has no inflater).
+*/
+unsigned char *
+GetAssetData(asset_pack *Pack, asset_pack_entry *Entry, unsigned int *Size, bool *IsOwned)
+{
+	unsigned char *Result = Pack->Memory + Entry->Offset;
+	*Size    = Entry->Size;
+	*IsOwned = false;
+	
+	int InflatedSize = Entry->Params[ASSET_PACK_INFLATED_SIZE];
+	if(InflatedSize > 0)
+	{
+		unsigned char *Inflated = 0;
+#ifdef ASSET_PACK_INFLATE
+		Inflated = (unsigned char *)MemAlloc((unsigned int)InflatedSize);
+		if(Inflated && (sinflate(Inflated, InflatedSize, Result, (int)Entry->Size) != InflatedSize))
+		{
+			MemFree(Inflated);
+			Inflated = 0;
+		}
+#endif
+		
+		Result   = Inflated;
+		*Size    = Inflated ? (unsigned int)InflatedSize : 0;
+		*IsOwned = (Inflated != 0);
+	}
+	
+	return(Result);
+}
+
+//NOTE(moritz): Points right into the pack unless the entry was deflated, see GetAssetData
+Image
+GetPackedImage(asset_pack *Pack, asset_pack_entry *Entry, bool *IsOwned)
+{
+	Image Result = {};
+	
+	unsigned int Size;
+	unsigned char *Data = GetAssetData(Pack, Entry, &Size, IsOwned);
+	if(Data && (Entry->Params[0] > 0) && (Entry->Params[1] > 0) &&
+	   (Size >= (unsigned int)(4*Entry->Params[0]*Entry->Params[1])))
+	{
+		Result.data    = Data;
+		Result.width   = Entry->Params[0];
+		Result.height  = Entry->Params[1];
+		Result.mipmaps = 1;
+		Result.format  = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+	}
+	else if(*IsOwned)
+	{
+		MemFree(Data);
+		*IsOwned = false;
+	}
+	
+	return(Result);
+}
+
+//NOTE(moritz): Same deal as GetPackedImage
+Wave
+GetPackedWave(asset_pack *Pack, asset_pack_entry *Entry, bool *IsOwned)
+{
+	Wave Result = {};
+	
+	unsigned int Size;
+	unsigned char *Data = GetAssetData(Pack, Entry, &Size, IsOwned);
+	
+	unsigned int FrameCount = (unsigned int)Entry->Params[0];
+	unsigned int SampleSize = (unsigned int)Entry->Params[2];
+	unsigned int Channels   = (unsigned int)Entry->Params[3];
+	unsigned int WaveSize   = FrameCount*Channels*(SampleSize/8);
+	if(Data && WaveSize && (WaveSize <= Size))
+	{
+		Result.frameCount = FrameCount;
+		Result.sampleRate = (unsigned int)Entry->Params[1];
+		Result.sampleSize = SampleSize;
+		Result.channels   = Channels;
+		Result.data       = Data;
+	}
+	else if(*IsOwned)
+	{
+		MemFree(Data);
+		*IsOwned = false;
+	}
+	
+	return(Result);
+}
+
+Color
+AverageImageColor(Image SpriteImage)
+{
+	Color *Colors = LoadImageColors(SpriteImage);
+	
+	float SumR = 0.0f;
+	float SumG = 0.0f;
+	float SumB = 0.0f;
+	float SumA = 0.0f;
+	int PixelCount = SpriteImage.width*SpriteImage.height;
+	for(int PixelIndex = 0;
+		PixelIndex < PixelCount;
+		++PixelIndex)
+	{
+		float Alpha = (float)Colors[PixelIndex].a;
+		SumR += Alpha*(float)Colors[PixelIndex].r;
+		SumG += Alpha*(float)Colors[PixelIndex].g;
+		SumB += Alpha*(float)Colors[PixelIndex].b;
+		SumA += Alpha;
+	}
+	
+	UnloadImageColors(Colors);
+	
+	Color Result = BLANK;
+	if(SumA > 0.0f)
+	{
+		Result.r = (unsigned char)(SumR/SumA);
+		Result.g = (unsigned char)(SumG/SumA);
+		Result.b = (unsigned char)(SumB/SumA);
+		Result.a = (unsigned char)(SumA/(float)PixelCount);
+	}
+	
+	return(Result);
+}
+
+/* NOTE(moritz):
+Mip chains for the billboards are baked offline by code/bake_mips.py (a custom command in
+CMakeLists.txt), since GenTextureMipmaps doesn't work for the wasm build. Level 0 is resized to the
+next power of two so WebGL can mip it, every following level is half the size of the one before.
+
+The texture keeps the png's width/height, which is what all the sprite layout works with.
+The UVs still cover the whole power of two texture, so that just works when drawing.
+LoadImageFromTexture on one of these reads back the wrong size though, so don't!
+*/
+
+#define BAKED_MIP_MAGIC 0x504d4653 //NOTE(moritz): 'SFMP'
+#define BAKED_MIP_VERSION 1
+
+struct baked_mip_header
+{
+	unsigned int Magic;
+	unsigned int Version;
+	
+	int Width;
+	int Height;
+	
+	int StoredWidth;
+	int StoredHeight;
+	
+	int MipCount;
+};
+
+/* NOTE(moritz):
+Sound effects get encoded offline by code/encode_sfx.py into a 4 bit adpcm format (.sfa), about
+3.5x smaller than the wav. The layout is described in the script. Every 256 samples of a channel
+decode on their own, 8 of those blocks run side by side in the 16 bit lanes of an SSE2 register.
+
+That makes random access cheap, so a compact sound can either be decoded in one go at load
+(DecodeCompactSound, what the engine layers do) or get mixed straight from the compressed groups
+(DecodeCompactSoundGroup, what the sfx mixer does). A sound the codec can't keep above the
+script's SNR floor gets an empty .sfa and ships as its wav instead.
+*/
+
+#define COMPACT_SOUND_MAGIC 0x44414653 //NOTE(moritz): 'SFAD'
+#define COMPACT_SOUND_VERSION 2
+
+#define COMPACT_SOUND_LANES 8
+#define COMPACT_SOUND_SLICE_SAMPLES 16
+#define COMPACT_SOUND_SLICES 16
+#define COMPACT_SOUND_BLOCK_SAMPLES (COMPACT_SOUND_SLICE_SAMPLES*COMPACT_SOUND_SLICES)
+
+//NOTE(moritz): Slice header: scale index in the low 5 bits, predictor (0, s1, s1 + slope/2, s1 + slope) in the next 2
+#define COMPACT_SOUND_SCALE_MASK 0x1f
+#define COMPACT_SOUND_PREDICTOR_SHIFT 5
+
+//NOTE(moritz): Same table as SCALES in encode_sfx.py
+global short CompactSoundScales[] =
+{
+	1, 2, 3, 4, 5, 6, 7, 8, 9, 11, 15, 19, 25, 33, 43, 56,
+	73, 96, 125, 164, 214, 280, 366, 479, 626, 819, 1071, 1400, 1831, 2395, 3132, 4096,
+};
+
+#define COMPACT_SOUND_SLICE_SIZE (COMPACT_SOUND_LANES + (COMPACT_SOUND_LANES/2)*COMPACT_SOUND_SLICE_SAMPLES)
+#define COMPACT_SOUND_GROUP_SIZE (2*sizeof(short)*COMPACT_SOUND_LANES + COMPACT_SOUND_SLICES*COMPACT_SOUND_SLICE_SIZE)
+
+//NOTE(moritz): Samples in one group, whatever the channel count
+#define COMPACT_SOUND_GROUP_SAMPLES (COMPACT_SOUND_LANES*COMPACT_SOUND_BLOCK_SAMPLES)
+
+struct compact_sound_header
+{
+	unsigned int Magic;
+	unsigned int Version;
+	
+	int Channels;
+	int SampleRate;
+	int FrameCount;
+	int GroupCount;
+};
+
+struct compact_sound
+{
+	unsigned char *Groups;
+	unsigned int GroupCount;
+	unsigned int GroupFrames;
+	
+	unsigned int Channels;
+	unsigned int SampleRate;
+	unsigned int FrameCount;
+};
+
+bool
+OpenCompactSound(compact_sound *Sound, unsigned char *Data, unsigned int Size)
+{
+	*Sound = {};
+	
+	compact_sound_header *Header = (compact_sound_header *)Data;
+	if(!Data || (Size < sizeof(compact_sound_header)) ||
+	   (Header->Magic != COMPACT_SOUND_MAGIC) || (Header->Version != COMPACT_SOUND_VERSION) ||
+	   ((Header->Channels != 1) && (Header->Channels != 2)) || (Header->SampleRate <= 0) ||
+	   (Header->FrameCount <= 0) || (Header->GroupCount <= 0))
+		return(false);
+	
+	unsigned int GroupFrames = COMPACT_SOUND_GROUP_SAMPLES/(unsigned int)Header->Channels;
+	if(((unsigned int)Header->GroupCount*GroupFrames < (unsigned int)Header->FrameCount) ||
+	   ((Size - sizeof(compact_sound_header))/COMPACT_SOUND_GROUP_SIZE < (unsigned int)Header->GroupCount))
+		return(false);
+	
+	Sound->Groups      = Data + sizeof(compact_sound_header);
+	Sound->GroupCount  = (unsigned int)Header->GroupCount;
+	Sound->GroupFrames = GroupFrames;
+	Sound->Channels    = (unsigned int)Header->Channels;
+	Sound->SampleRate  = (unsigned int)Header->SampleRate;
+	Sound->FrameCount  = (unsigned int)Header->FrameCount;
+	
+	return(true);
+}
+
+inline short
+SaturateS16(int Value)
+{
+	short Result = (short)((Value < -32768) ? -32768 : ((Value > 32767) ? 32767 : Value));
+	return(Result);
+}
+
+//NOTE(moritz): Writes the whole group (GroupFrames interleaved frames), even past the end of the sound
+void
+DecodeCompactSoundGroup(compact_sound *Sound, unsigned int GroupIndex, short *Out)
+{
+	unsigned char *At = Sound->Groups + GroupIndex*COMPACT_SOUND_GROUP_SIZE;
+	
+	//NOTE(moritz): Sample i of lane l at LaneSamples[i][l], transposed into Out at the end
+	short LaneSamples[COMPACT_SOUND_BLOCK_SAMPLES][COMPACT_SOUND_LANES];
+	
+	short Scales[COMPACT_SOUND_LANES];
+	short BaseMasks[COMPACT_SOUND_LANES];  //NOTE(moritz): s1 goes into the prediction
+	short SlopeMasks[COMPACT_SOUND_LANES]; //NOTE(moritz): All of the slope goes in
+	short HalfMasks[COMPACT_SOUND_LANES];  //NOTE(moritz): Half of it goes in
+	
+#if defined(__SSE2__)
+	__m128i S1 = _mm_loadu_si128((__m128i *)At);
+	__m128i S2 = _mm_loadu_si128((__m128i *)(At + sizeof(short)*COMPACT_SOUND_LANES));
+	At += 2*sizeof(short)*COMPACT_SOUND_LANES;
+	
+	__m128i Zero  = _mm_setzero_si128();
+	__m128i Low4  = _mm_set1_epi8(0x0f);
+	__m128i Eight = _mm_set1_epi16(8);
+#else
+	short S1[COMPACT_SOUND_LANES];
+	short S2[COMPACT_SOUND_LANES];
+	memcpy(S1, At, sizeof(S1));
+	memcpy(S2, At + sizeof(S1), sizeof(S2));
+	At += sizeof(S1) + sizeof(S2);
+#endif
+	
+	for(int SliceIndex = 0;
+		SliceIndex < COMPACT_SOUND_SLICES;
+		++SliceIndex)
+	{
+		for(int Lane = 0;
+			Lane < COMPACT_SOUND_LANES;
+			++Lane)
+		{
+			int Predictor = (At[Lane] >> COMPACT_SOUND_PREDICTOR_SHIFT) & 3;
+			Scales[Lane]     = CompactSoundScales[At[Lane] & COMPACT_SOUND_SCALE_MASK];
+			BaseMasks[Lane]  = (Predictor != 0) ? -1 : 0;
+			SlopeMasks[Lane] = (Predictor == 3) ? -1 : 0;
+			HalfMasks[Lane]  = (Predictor == 2) ? -1 : 0;
+		}
+		At += COMPACT_SOUND_LANES;
+		
+#if defined(__SSE2__)
+		__m128i Scale     = _mm_loadu_si128((__m128i *)Scales);
+		__m128i BaseMask  = _mm_loadu_si128((__m128i *)BaseMasks);
+		__m128i SlopeMask = _mm_loadu_si128((__m128i *)SlopeMasks);
+		__m128i HalfMask  = _mm_loadu_si128((__m128i *)HalfMasks);
+#endif
+		
+		for(int SampleIndex = 0;
+			SampleIndex < COMPACT_SOUND_SLICE_SAMPLES;
+			++SampleIndex)
+		{
+			short *Dest = LaneSamples[SliceIndex*COMPACT_SOUND_SLICE_SAMPLES + SampleIndex];
+			
+#if defined(__SSE2__)
+			int Packed;
+			memcpy(&Packed, At, sizeof(Packed));
+			
+			//NOTE(moritz): 4 bytes of nibbles -> 8 signed 16 bit codes, lane 2i is the low nibble of byte i
+			__m128i Bytes = _mm_cvtsi32_si128(Packed);
+			__m128i Lo    = _mm_and_si128(Bytes, Low4);
+			__m128i Hi    = _mm_and_si128(_mm_srli_epi16(Bytes, 4), Low4);
+			__m128i Codes = _mm_unpacklo_epi8(_mm_unpacklo_epi8(Lo, Hi), Zero);
+			Codes = _mm_sub_epi16(_mm_xor_si128(Codes, Eight), Eight);
+			
+			__m128i Slope = _mm_subs_epi16(S1, S2);
+			__m128i Delta = _mm_or_si128(_mm_and_si128(Slope, SlopeMask),
+										 _mm_and_si128(_mm_srai_epi16(Slope, 1), HalfMask));
+			__m128i Prediction = _mm_adds_epi16(_mm_and_si128(S1, BaseMask), Delta);
+			__m128i Sample     = _mm_adds_epi16(Prediction, _mm_mullo_epi16(Codes, Scale));
+			_mm_storeu_si128((__m128i *)Dest, Sample);
+			
+			S2 = S1;
+			S1 = Sample;
+#else
+			for(int Lane = 0;
+				Lane < COMPACT_SOUND_LANES;
+				++Lane)
+			{
+				int Code = (At[Lane/2] >> (4*(Lane & 1))) & 0x0f;
+				Code = (Code ^ 8) - 8;
+				
+				short Slope = SaturateS16(S1[Lane] - S2[Lane]);
+				short Delta = (short)((Slope & SlopeMasks[Lane]) | ((Slope >> 1) & HalfMasks[Lane]));
+				short Prediction = SaturateS16((S1[Lane] & BaseMasks[Lane]) + Delta);
+				short Sample     = SaturateS16(Prediction + Code*Scales[Lane]);
+				Dest[Lane] = Sample;
+				
+				S2[Lane] = S1[Lane];
+				S1[Lane] = Sample;
+			}
+#endif
+			At += COMPACT_SOUND_LANES/2;
+		}
+	}
+	
+	unsigned int Channels = Sound->Channels;
+	for(int Lane = 0;
+		Lane < COMPACT_SOUND_LANES;
+		++Lane)
+	{
+		short *Dest = Out + (Lane/Channels)*COMPACT_SOUND_BLOCK_SAMPLES*Channels + (Lane % Channels);
+		for(int SampleIndex = 0;
+			SampleIndex < COMPACT_SOUND_BLOCK_SAMPLES;
+			++SampleIndex)
+		{
+			Dest[SampleIndex*Channels] = LaneSamples[SampleIndex][Lane];
+		}
+	}
+}
+
+//NOTE(moritz): Owned, gets unloaded with UnloadWave
+Wave
+DecodeCompactSound(compact_sound *Sound)
+{
+	Wave Result = {};
+	
+	unsigned int SampleCount = Sound->FrameCount*Sound->Channels;
+	short *Samples = (short *)malloc(sizeof(short)*SampleCount);
+	
+	short *At = Samples;
+	for(unsigned int GroupIndex = 0;
+		GroupIndex < Sound->GroupCount;
+		++GroupIndex)
+	{
+		unsigned int GroupSampleCount = COMPACT_SOUND_GROUP_SAMPLES;
+		if(GroupSampleCount > (unsigned int)(Samples + SampleCount - At))
+			GroupSampleCount = (unsigned int)(Samples + SampleCount - At);
+		
+		if(GroupSampleCount == COMPACT_SOUND_GROUP_SAMPLES)
+		{
+			DecodeCompactSoundGroup(Sound, GroupIndex, At);
+		}
+		else
+		{
+			//NOTE(moritz): Last group, only part of it is real
+			short Tail[COMPACT_SOUND_GROUP_SAMPLES];
+			DecodeCompactSoundGroup(Sound, GroupIndex, Tail);
+			memcpy(At, Tail, sizeof(short)*GroupSampleCount);
+		}
+		At += GroupSampleCount;
+	}
+	
+	Result.frameCount = Sound->FrameCount;
+	Result.sampleRate = Sound->SampleRate;
+	Result.sampleSize = 16;
+	Result.channels   = Sound->Channels;
+	Result.data       = Samples;
+	
+	return(Result);
+}
+
+/* NOTE(moritz):
+Asset loading is split in two. DecodeAssetJob does everything that only needs the CPU (png/wav
+decode when there is no pack, reading mip files, impostor colors) and is fine on any thread.
+The upload (LoadTextureFromImage, LoadSoundFromWave) stays on the main thread, that's where the
+GL context lives and sounds need the audio device, which only opens on the first click.
+
+At startup DecodeAssetJobs runs the whole StartupAssetJobs table on a small worker pool, the
+Load*Asset functions further down then only upload what's already decoded. Anything not in the
+table gets decoded right there on the main thread.
+
+Web builds have no pthreads, there the jobs just run one after the other.
+Careful with raylib calls in the decode, TextFormat and friends hand out static buffers!
+*/
+
+//#define ASSET_LOADER_SERIAL
+
+#if !defined(__EMSCRIPTEN__) && !defined(ASSET_LOADER_SERIAL)
+#define ASSET_LOADER_THREADS
+#endif
+
+#define ASSET_LOADER_MAX_THREADS 16
+
+enum asset_job_kind
+{
+	AssetJob_Texture,
+	AssetJob_BillboardTexture,
+	AssetJob_Sound,
+	AssetJob_File,
+};
+
+struct asset_job
+{
+	const char *FileName;
+	asset_job_kind Kind;
+	
+	bool IsDecoded;
+	double DecodeSeconds;
+	
+	//NOTE(moritz): Point into the asset pack, unless the matching IsOwned is set
+	Image Pixels;
+	Wave Samples;
+	bool PixelsAreOwned;
+	bool SamplesAreOwned;
+	unsigned char *FileData; //NOTE(moritz): Loose mip file (Pixels point into it) or AssetJob_File
+	
+	//NOTE(moritz): AssetJob_File only, either FileData or straight from the pack
+	unsigned char *Bytes;
+	unsigned int ByteCount;
+	
+	//NOTE(moritz): Billboards only
+	bool IsBaked;
+	int LayoutWidth;
+	int LayoutHeight;
+	Color AverageColor;
+};
+
+struct asset_loader
+{
+	asset_job *Jobs;
+	int JobCount;
+	
+#ifdef ASSET_LOADER_THREADS
+	std::atomic<int> NextJobIndex;
+#endif
+};
+
+global asset_job StartupAssetJobs[] =
+{
+	{"tree.png",             AssetJob_BillboardTexture},
+	{"building_right.png",   AssetJob_BillboardTexture},
+	{"building_left.png",    AssetJob_BillboardTexture},
+	{"skyscraper_right.png", AssetJob_BillboardTexture},
+	{"skyscraper_left.png",  AssetJob_BillboardTexture},
+	{"lantern_left.png",     AssetJob_BillboardTexture},
+	{"lantern_right.png",    AssetJob_BillboardTexture},
+	{"civil_car.png",        AssetJob_BillboardTexture},
+	
+	{"player_car.png",       AssetJob_Texture},
+	{"sunset.png",           AssetJob_Texture},
+	{"crosshair.png",        AssetJob_Texture},
+	{"alien.png",            AssetJob_Texture},
+	{"emp.png",              AssetJob_Texture},
+	{"dithered_horizon.png", AssetJob_Texture},
+	{"crosshair0.png",       AssetJob_Texture},
+	{"crosshair1.png",       AssetJob_Texture},
+	{"fire0.png",            AssetJob_Texture},
+	{"fire1.png",            AssetJob_Texture},
+	{"car_plain.png",        AssetJob_Texture},
+	{"car_shadow.png",       AssetJob_Texture},
+	{"city0.png",            AssetJob_Texture},
+	{"city1.png",            AssetJob_Texture},
+	{"city2.png",            AssetJob_Texture},
+	{"city3.png",            AssetJob_Texture},
+	{"city4.png",            AssetJob_Texture},
+	
+	{"engine0.wav",          AssetJob_Sound},
+	{"engine1.wav",          AssetJob_Sound},
+	{"engine2.wav",          AssetJob_Sound},
+	{"engine3.wav",          AssetJob_Sound},
+	{"engine4.wav",          AssetJob_Sound},
+	{"engine5.wav",          AssetJob_Sound},
+	{"engine6.wav",          AssetJob_Sound},
+	{"engine7.wav",          AssetJob_Sound},
+	
+	//NOTE(moritz): The sfx mixer plays these straight from the compressed bytes. When encode_sfx.py
+	//kept a sound as pcm its .sfa is empty (and not in the pack), the mixer falls back to the wav then
+	{"lazer.sfa",            AssetJob_File},
+	{"crosshair_blip.sfa",   AssetJob_File},
+	
+	//NOTE(moritz): Only the bytes, the music gets decoded as it plays
+	{"music.mp3",            AssetJob_File},
+};
+
+global asset_loader AssetLoader;
+
+//NOTE(moritz): Missing and empty loose files get skipped quietly. raylib warns about empty ones,
+//and the .sfa of a sound encode_sfx.py kept as pcm is one on every startup.
+inline bool
+LooseFileHasData(const char *FileName)
+{
+	bool Result = (GetFileLength(FileName) > 0);
+	return(Result);
+}
+
+void
+DecodeImageAsset(asset_job *Job)
+{
+	asset_pack_entry *Entry = FindAsset(&AssetPack, Job->FileName, AssetType_Image);
+	if(Entry)
+		Job->Pixels = GetPackedImage(&AssetPack, Entry, &Job->PixelsAreOwned);
+	
+	if(!Job->Pixels.data)
+	{
+		Job->Pixels = LoadImage(Job->FileName);
+		Job->PixelsAreOwned = true;
+	}
+}
+
+void
+DecodeBakedMips(asset_job *Job)
+{
+	//NOTE(moritz): Not TextFormat/GetFileNameWithoutExt, this might be running on a worker
+	char MipFileName[ASSET_PACK_NAME_SIZE];
+	const char *Extension = strrchr(Job->FileName, '.');
+	int BaseLength = Extension ? (int)(Extension - Job->FileName) : (int)strlen(Job->FileName);
+	snprintf(MipFileName, sizeof(MipFileName), "%.*s.mip", BaseLength, Job->FileName);
+	
+	unsigned int FileSize = 0;
+	unsigned char *FileData = 0;
+	
+	asset_pack_entry *Entry = FindAsset(&AssetPack, MipFileName, AssetType_Raw);
+	if(Entry)
+	{
+		bool IsOwned;
+		FileData = GetAssetData(&AssetPack, Entry, &FileSize, &IsOwned);
+		if(IsOwned)
+			Job->FileData = FileData;
+	}
+	else if(LooseFileHasData(MipFileName))
+	{
+		FileData = LoadFileData(MipFileName, &FileSize);
+		Job->FileData = FileData;
+	}
+	
+	if(FileData)
+	{
+		baked_mip_header *Header = (baked_mip_header *)FileData;
+		
+		if((FileSize >= sizeof(baked_mip_header)) &&
+		   (Header->Magic == BAKED_MIP_MAGIC) && (Header->Version == BAKED_MIP_VERSION))
+		{
+			//NOTE(moritz): Make sure all the levels are actually in there
+			int MipDataSize = 0;
+			int LastMipOffset = 0;
+			int MipWidth  = Header->StoredWidth;
+			int MipHeight = Header->StoredHeight;
+			for(int MipIndex = 0;
+				MipIndex < Header->MipCount;
+				++MipIndex)
+			{
+				LastMipOffset = MipDataSize;
+				MipDataSize += 4*MipWidth*MipHeight;
+				MipWidth  = (MipWidth  > 1) ? (MipWidth/2)  : 1;
+				MipHeight = (MipHeight > 1) ? (MipHeight/2) : 1;
+			}
+			
+			if((Header->MipCount > 0) && (FileSize >= (sizeof(baked_mip_header) + MipDataSize)))
+			{
+				unsigned char *MipData = FileData + sizeof(baked_mip_header);
+				
+				Job->Pixels.data    = MipData;
+				Job->Pixels.width   = Header->StoredWidth;
+				Job->Pixels.height  = Header->StoredHeight;
+				Job->Pixels.mipmaps = Header->MipCount;
+				Job->Pixels.format  = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+				
+				Job->LayoutWidth  = Header->Width;
+				Job->LayoutHeight = Header->Height;
+				
+				//NOTE(moritz): The baker filters with premultiplied alpha, so the 1x1 level already is the impostor color
+				unsigned char *LastMip = MipData + LastMipOffset;
+				Job->AverageColor = {LastMip[0], LastMip[1], LastMip[2], LastMip[3]};
+				
+				Job->IsBaked = true;
+			}
+		}
+	}
+	
+	if(!Job->IsBaked && Job->FileData)
+	{
+		UnloadFileData(Job->FileData);
+		Job->FileData = 0;
+	}
+}
+
+//NOTE(moritz): Looks for the .sfa of a wav and decodes the whole thing, Job->Samples end up owned
+void
+DecodeCompactSoundAsset(asset_job *Job)
+{
+	char CompactFileName[ASSET_PACK_NAME_SIZE];
+	const char *Extension = strrchr(Job->FileName, '.');
+	int BaseLength = Extension ? (int)(Extension - Job->FileName) : (int)strlen(Job->FileName);
+	snprintf(CompactFileName, sizeof(CompactFileName), "%.*s.sfa", BaseLength, Job->FileName);
+	
+	unsigned int FileSize = 0;
+	unsigned char *FileData = 0;
+	unsigned char *OwnedFileData = 0;
+	
+	asset_pack_entry *Entry = FindAsset(&AssetPack, CompactFileName, AssetType_Raw);
+	if(Entry)
+	{
+		bool IsOwned;
+		FileData = GetAssetData(&AssetPack, Entry, &FileSize, &IsOwned);
+		if(IsOwned)
+			OwnedFileData = FileData;
+	}
+	else if(LooseFileHasData(CompactFileName))
+	{
+		OwnedFileData = LoadFileData(CompactFileName, &FileSize);
+		FileData = OwnedFileData;
+	}
+	
+	compact_sound Sound;
+	if(OpenCompactSound(&Sound, FileData, FileSize))
+	{
+		Job->Samples = DecodeCompactSound(&Sound);
+		Job->SamplesAreOwned = true;
+	}
+	
+	if(OwnedFileData)
+		UnloadFileData(OwnedFileData);
+}
+
+void
+DecodeAssetJob(asset_job *Job)
+{
+	double StartTime = GetTime();
+	
+	switch(Job->Kind)
+	{
+		case AssetJob_Texture:
+		{
+			DecodeImageAsset(Job);
+		} break;
+		
+		case AssetJob_BillboardTexture:
+		{
+			DecodeBakedMips(Job);
+			if(!Job->IsBaked)
+			{
+				TraceLog(LOG_INFO, "No baked mips for %s, sampling it bilinear only", Job->FileName);
+				
+				DecodeImageAsset(Job);
+				if(Job->Pixels.data)
+					Job->AverageColor = AverageImageColor(Job->Pixels);
+				Job->LayoutWidth  = Job->Pixels.width;
+				Job->LayoutHeight = Job->Pixels.height;
+			}
+		} break;
+		
+		case AssetJob_Sound:
+		{
+			DecodeCompactSoundAsset(Job);
+			
+			asset_pack_entry *Entry = Job->Samples.data ? 0 : FindAsset(&AssetPack, Job->FileName, AssetType_Sound);
+			if(Entry)
+				Job->Samples = GetPackedWave(&AssetPack, Entry, &Job->SamplesAreOwned);
+			
+			if(!Job->Samples.data)
+			{
+				Job->Samples = LoadWave(Job->FileName);
+				Job->SamplesAreOwned = true;
+			}
+		} break;
+		
+		case AssetJob_File:
+		{
+			asset_pack_entry *Entry = FindAsset(&AssetPack, Job->FileName, AssetType_Raw);
+			if(Entry)
+			{
+				bool IsOwned;
+				Job->Bytes = GetAssetData(&AssetPack, Entry, &Job->ByteCount, &IsOwned);
+				if(IsOwned)
+					Job->FileData = Job->Bytes;
+			}
+			else if(LooseFileHasData(Job->FileName))
+			{
+				Job->FileData  = LoadFileData(Job->FileName, &Job->ByteCount);
+				Job->Bytes     = Job->FileData;
+			}
+		} break;
+	}
+	
+	Job->DecodeSeconds = GetTime() - StartTime;
+	Job->IsDecoded = true;
+}
+
+//NOTE(moritz): Frees whatever the decode allocated, the job can be decoded again afterwards
+void
+ReleaseAssetJob(asset_job *Job)
+{
+	if(Job->PixelsAreOwned)
+		UnloadImage(Job->Pixels);
+	if(Job->SamplesAreOwned)
+		UnloadWave(Job->Samples);
+	if(Job->FileData)
+		UnloadFileData(Job->FileData);
+	
+	asset_job Released = {};
+	Released.FileName = Job->FileName;
+	Released.Kind     = Job->Kind;
+	*Job = Released;
+}
+
+#ifdef ASSET_LOADER_THREADS
+void
+AssetLoaderWorker(asset_loader *Loader)
+{
+	for(;;)
+	{
+		int JobIndex = Loader->NextJobIndex++;
+		if(JobIndex >= Loader->JobCount)
+			break;
+		
+		DecodeAssetJob(Loader->Jobs + JobIndex);
+	}
+}
+#endif
+
+void
+DecodeAssetJobs(asset_loader *Loader, asset_job *Jobs, int JobCount)
+{
+	double StartTime = GetTime();
+	
+	Loader->Jobs     = Jobs;
+	Loader->JobCount = JobCount;
+	
+	int ThreadCount = 1;
+#ifdef ASSET_LOADER_THREADS
+	Loader->NextJobIndex = 0;
+	
+	//NOTE(moritz): The main thread pitches in too
+	int WorkerCount = (int)std::thread::hardware_concurrency() - 1;
+	if(WorkerCount > (ASSET_LOADER_MAX_THREADS - 1))
+		WorkerCount = ASSET_LOADER_MAX_THREADS - 1;
+	if(WorkerCount > (JobCount - 1))
+		WorkerCount = JobCount - 1;
+	if(WorkerCount < 0)
+		WorkerCount = 0;
+	
+	std::thread Workers[ASSET_LOADER_MAX_THREADS];
+	for(int WorkerIndex = 0;
+		WorkerIndex < WorkerCount;
+		++WorkerIndex)
+	{
+		Workers[WorkerIndex] = std::thread(AssetLoaderWorker, Loader);
+	}
+	
+	AssetLoaderWorker(Loader);
+	
+	for(int WorkerIndex = 0;
+		WorkerIndex < WorkerCount;
+		++WorkerIndex)
+	{
+		Workers[WorkerIndex].join();
+	}
+	
+	ThreadCount += WorkerCount;
+#else
+	for(int JobIndex = 0;
+		JobIndex < JobCount;
+		++JobIndex)
+	{
+		DecodeAssetJob(Jobs + JobIndex);
+	}
+#endif
+	
+	double DecodeSeconds = 0.0;
+	for(int JobIndex = 0;
+		JobIndex < JobCount;
+		++JobIndex)
+	{
+		TraceLog(LOG_INFO, "Decoded %s in %.2f ms", Jobs[JobIndex].FileName, 1000.0*Jobs[JobIndex].DecodeSeconds);
+		DecodeSeconds += Jobs[JobIndex].DecodeSeconds;
+	}
+	
+	TraceLog(LOG_INFO, "Decoded %d assets in %.1f ms on %d thread(s), %.1f ms of decode work", JobCount,
+			 1000.0*(GetTime() - StartTime), ThreadCount, 1000.0*DecodeSeconds);
+}
+
+//NOTE(moritz): The already decoded startup job if there is one, otherwise Scratch gets decoded here
+asset_job *
+BeginAssetLoad(asset_loader *Loader, asset_job *Scratch, const char *FileName, asset_job_kind Kind)
+{
+	for(int JobIndex = 0;
+		JobIndex < Loader->JobCount;
+		++JobIndex)
+	{
+		asset_job *Job = Loader->Jobs + JobIndex;
+		if(Job->IsDecoded && (Job->Kind == Kind) && (strcmp(Job->FileName, FileName) == 0))
+			return(Job);
+	}
+	
+	*Scratch = {};
+	Scratch->FileName = FileName;
+	Scratch->Kind     = Kind;
+	DecodeAssetJob(Scratch);
+	
+	return(Scratch);
+}
+
+Texture2D
+LoadTextureAsset(const char *FileName)
+{
+	asset_job Scratch;
+	asset_job *Job = BeginAssetLoad(&AssetLoader, &Scratch, FileName, AssetJob_Texture);
+	
+	Texture2D Result = {};
+	if(Job->Pixels.data)
+		Result = LoadTextureFromImage(Job->Pixels);
+	
+	ReleaseAssetJob(Job);
+	
+	return(Result);
+}
+
+//NOTE(moritz): Always owned by the caller, gets unloaded with UnloadImage
+Image
+LoadImageAsset(const char *FileName)
+{
+	asset_job Scratch;
+	asset_job *Job = BeginAssetLoad(&AssetLoader, &Scratch, FileName, AssetJob_Texture);
+	
+	Image Result = {};
+	if(Job->PixelsAreOwned)
+	{
+		Result = Job->Pixels;
+		Job->PixelsAreOwned = false;
+	}
+	else if(Job->Pixels.data)
+	{
+		Result = ImageCopy(Job->Pixels);
+	}
+	
+	ReleaseAssetJob(Job);
+	
+	return(Result);
+}
+
+//NOTE(moritz): Always owned by the caller, gets unloaded with UnloadWave
+Wave
+LoadWaveAsset(const char *FileName)
+{
+	asset_job Scratch;
+	asset_job *Job = BeginAssetLoad(&AssetLoader, &Scratch, FileName, AssetJob_Sound);
+	
+	Wave Result = {};
+	if(Job->SamplesAreOwned)
+	{
+		Result = Job->Samples;
+		Job->SamplesAreOwned = false;
+	}
+	else if(Job->Samples.data)
+	{
+		Result = WaveCopy(Job->Samples);
+	}
+	
+	ReleaseAssetJob(Job);
+	
+	return(Result);
+}
+
+//NOTE(moritz): Never freed, stays around for as long as the game runs (e.g. music that streams from it)
+unsigned char *
+LoadFileAsset(const char *FileName, unsigned int *ByteCount)
+{
+	asset_job Scratch;
+	asset_job *Job = BeginAssetLoad(&AssetLoader, &Scratch, FileName, AssetJob_File);
+	
+	unsigned char *Result = Job->Bytes;
+	*ByteCount = Job->ByteCount;
+	
+	//NOTE(moritz): Hand the bytes over instead of releasing them with the job
+	Job->FileData = 0;
+	ReleaseAssetJob(Job);
+	
+	return(Result);
+}
+
+Texture2D
+LoadBillboardTexture(const char *FileName, Color *AverageColor)
+{
+	asset_job Scratch;
+	asset_job *Job = BeginAssetLoad(&AssetLoader, &Scratch, FileName, AssetJob_BillboardTexture);
+	
+	Texture2D Result = {};
+	if(Job->Pixels.data)
+	{
+		Result = LoadTextureFromImage(Job->Pixels);
+		Result.width  = Job->LayoutWidth;
+		Result.height = Job->LayoutHeight;
+		
+		if(Job->IsBaked)
+		{
+			SetTextureFilter(Result, TEXTURE_FILTER_TRILINEAR);
+			SetTextureWrap(Result, TEXTURE_WRAP_CLAMP);
+		}
+		else
+		{
+			SetTextureFilter(Result, TEXTURE_FILTER_BILINEAR);
+		}
+	}
+	
+	*AverageColor = Job->AverageColor;
+	
+	ReleaseAssetJob(Job);
+	
+	return(Result);
+}
+
+struct thing
+{
+	int ID;
+	
+	bool IsDeleted;
+	bool IsAlien;
+	bool IsBullet;
+	
+	float Distance;
+	float XOffset;
+	
+	float Speed;
+	
+	//NOTE(moritz): These only for aliens
+	float ShootTimer; //in seconds
+	float FireInterval;
+	int BulletPattern;
+	int PatternStep;
+	float HoverDistance;
+	float Lifetime; //NOTE(moritz): Seconds left, F32Max stays forever
+	int WaveIndex;
+	
+	int BandIndex; //0: vehicles... 1: first band etc...
+	
+	//NOTE(moritz): Only relevant for roadside decoration
+	float RoadSide; //NOTE(moritz): -1: left, 1: right.. 0: vehicle?
+	
+	Color Tint;
+	
+	
+	//NOTE(moritz): Only relevant for the current frame
+	bool DrawMe;
+	
+	//NOTE(moritz): Shooting
+	Vector2 FramePosition;
+	float   FrameScale;
+	bool    FrameIsImpostor;
+	
+	//NOTE(moritz): Collision
+	Vector2 FrameBaseP;
+	float PrevDistance; //NOTE(moritz): Distance at the start of the tick, for the swept test
+	
+	billboard *Billboard;
+	
+	int NextIDInFreeList;
+};
+
+/*
+NOTE(moritz):
+Screen-space grid for picking, rebuilt every frame while the thing frame properties get determined.
+Only billboards with a pick mask go in. Things are inserted back to front (the order they are
+sorted and drawn in) and each cell list grows at its head, so walking a cell from the head
+visits the front-most thing first.
+*/
+#define PICK_GRID_CELL_SIZE   32
+#define PICK_GRID_MAX_CELLS_X 32
+#define PICK_GRID_MAX_CELLS_Y 32
+#define PICK_GRID_MAX_ENTRIES 4096
+
+struct pick_grid_entry
+{
+	thing *Thing;
+	int Next;
+};
+
+struct pick_grid
+{
+	int CellsX;
+	int CellsY;
+	
+	int CellFirst[PICK_GRID_MAX_CELLS_X*PICK_GRID_MAX_CELLS_Y];
+	
+	int EntryCount;
+	int DroppedEntryCount; //NOTE(moritz): Ran out of entries this frame, these things can't be picked
+	pick_grid_entry Entries[PICK_GRID_MAX_ENTRIES];
+};
+
+void
+ClearPickGrid(pick_grid *Grid)
+{
+	for(int CellIndex = 0;
+		CellIndex < (Grid->CellsX*Grid->CellsY);
+		++CellIndex)
+	{
+		Grid->CellFirst[CellIndex] = -1;
+	}
+	
+	Grid->EntryCount = 0;
+	Grid->DroppedEntryCount = 0;
+}
+
+void
+InitPickGrid(pick_grid *Grid, int ScreenWidth, int ScreenHeight)
+{
+	Grid->CellsX = (ScreenWidth  + PICK_GRID_CELL_SIZE - 1)/PICK_GRID_CELL_SIZE;
+	Grid->CellsY = (ScreenHeight + PICK_GRID_CELL_SIZE - 1)/PICK_GRID_CELL_SIZE;
+	
+	//NOTE(moritz): Anything past the last cell just can't be picked
+	if(Grid->CellsX > PICK_GRID_MAX_CELLS_X)
+		Grid->CellsX = PICK_GRID_MAX_CELLS_X;
+	if(Grid->CellsY > PICK_GRID_MAX_CELLS_Y)
+		Grid->CellsY = PICK_GRID_MAX_CELLS_Y;
+	
+	ClearPickGrid(Grid);
+}
+
+void
+InsertIntoPickGrid(pick_grid *Grid, thing *Thing, Vector2 Min, Vector2 Max)
+{
+	int CellX0 = (int)floorf(Min.x*(1.0f/PICK_GRID_CELL_SIZE));
+	int CellY0 = (int)floorf(Min.y*(1.0f/PICK_GRID_CELL_SIZE));
+	int CellX1 = (int)floorf(Max.x*(1.0f/PICK_GRID_CELL_SIZE));
+	int CellY1 = (int)floorf(Max.y*(1.0f/PICK_GRID_CELL_SIZE));
+	
+	if(CellX0 < 0)
+		CellX0 = 0;
+	if(CellY0 < 0)
+		CellY0 = 0;
+	if(CellX1 > (Grid->CellsX - 1))
+		CellX1 = Grid->CellsX - 1;
+	if(CellY1 > (Grid->CellsY - 1))
+		CellY1 = Grid->CellsY - 1;
+	
+	for(int CellY = CellY0;
+		CellY <= CellY1;
+		++CellY)
+	{
+		for(int CellX = CellX0;
+			CellX <= CellX1;
+			++CellX)
+		{
+			if(Grid->EntryCount >= PICK_GRID_MAX_ENTRIES)
+			{
+				++Grid->DroppedEntryCount;
+				return;
+			}
+			
+			int Cell = CellY*Grid->CellsX + CellX;
+			
+			int EntryIndex = Grid->EntryCount++;
+			Grid->Entries[EntryIndex].Thing = Thing;
+			Grid->Entries[EntryIndex].Next  = Grid->CellFirst[Cell];
+			Grid->CellFirst[Cell] = EntryIndex;
+		}
+	}
+}
+
+#define THING_IMPOSTOR_MAX_HEIGHT 3.0f
+
+void
+DetermineThingFrameProperties(billboard *Billboard, thing *Thing, float MaxDistance,
+							  float fScreenWidth, float fScreenHeight, depth_line *DepthLines, int DepthLineCount, 
+							  float CameraHeight, float *RoadCenterX, pick_grid *PickGrid, bool DebugText = false)
+{
+	float BaseRoadHalfWidth   = fScreenWidth*0.8f;
+	
+	if(Thing->IsDeleted)
+		return;
+	
+	Thing->DrawMe = true;
+	
+	int BandIndex = Thing->BandIndex;
+	if(BandIndex < 0)
+		BandIndex = 0;
+	if(BandIndex > (THING_BAND_COUNT - 1))
+		BandIndex = THING_BAND_COUNT - 1;
+	
+	if(Thing->Distance > MaxDistance)
+	{
+		Thing->DrawMe = false;
+		++FrameStats.BandCulled[BandIndex];
+		return;
+	}
+	
+	//NOTE(moirtz): Test for "scaling in" distant billboards instead of popping them in...
+	//float ScaleInDistance = 10.0f;
+	float OneOverScaleInDistance = 0.1f;
+	float ScaleInT = (MaxDistance - Thing->Distance)*OneOverScaleInDistance;
+	ScaleInT = Clamp(0.0f, ScaleInT, 1.0f);
+	
+	//if(DebugText)
+	//DrawText(TextFormat("TreeScaleInT: %f", ScaleInT), 20, 20, 10, RED);
+	
+	float OneOverMaxDistance = 1.0f/MaxDistance;
+	float BasePDepth = Thing->Distance*OneOverMaxDistance;
+	
+	//NOTE(moritz): Find the last depth line (back to front) with equal or smaller depth.
+	//Depth = CameraHeight/(DepthLineCount - Line) has a closed form inverse, the two loops
+	//only fix up float rounding so it matches walking all the lines.
+	int BasePDepthLineIndex = -1;
+	if(BasePDepth > 0.0f)
+	{
+		float fBaseLine = (float)DepthLineCount - CameraHeight/BasePDepth;
+		BasePDepthLineIndex = (int)floorf(ClampM(-1.0f, fBaseLine, (float)(DepthLineCount - 1)));
+		
+		while((BasePDepthLineIndex >= 0) && (DepthLines[BasePDepthLineIndex].Depth > BasePDepth))
+			--BasePDepthLineIndex;
+		while((BasePDepthLineIndex < (DepthLineCount - 1)) && (DepthLines[BasePDepthLineIndex + 1].Depth <= BasePDepth))
+			++BasePDepthLineIndex;
+	}
+	
+	if(BasePDepthLineIndex == -1)
+	{
+		Thing->DrawMe = false;
+		return;
+	}
+	
+	//NOTE(moritz): In case of vehicle either left or right is fine
+	Texture2D CurrentTexture = Billboard->TextureRight;
+	
+	if(Thing->RoadSide == -1.0f)
+		CurrentTexture = Billboard->TextureLeft;
+	else if(Thing->RoadSide == 1.0f)
+		CurrentTexture = Billboard->TextureRight;
+	
+	float BasePOffsetX = Thing->RoadSide*0.5f*((float)CurrentTexture.width) + Thing->XOffset;
+	float SpriteScale  = Billboard->SpriteScale;
+	float SpriteVerticalTweak = Billboard->SpriteVerticalTweak;
+	
+	//NOTE(moritz): Road center of the base depth line and the one below it, from the per frame road pass
+	int X0LineIndex = BasePDepthLineIndex - 1;
+	if(X0LineIndex < 0)
+		X0LineIndex = 0;
+	int X1LineIndex = BasePDepthLineIndex;
+	
+	float X0 = RoadCenterX[X0LineIndex] + Thing->RoadSide*BaseRoadHalfWidth*DepthLines[X0LineIndex].Scale + BasePOffsetX*DepthLines[X0LineIndex].Scale;
+	float X1 = RoadCenterX[X1LineIndex] + Thing->RoadSide*BaseRoadHalfWidth*DepthLines[X1LineIndex].Scale + BasePOffsetX*DepthLines[X1LineIndex].Scale;
+	
+	//NOTE(moritz): Cull before doing the rest. The sprite ends up somewhere between X0 and X1 and
+	//is never wider than at the base line's scale, so this only rejects what is surely off-screen.
+	float MaxFrameScale = DepthLines[BasePDepthLineIndex].Scale*SpriteScale*ScaleInT;
+	float MaxHalfWidth  = 0.5f*(float)CurrentTexture.width*MaxFrameScale;
+	if(((Max(X0, X1) + MaxHalfWidth) < 0.0f) ||
+	   ((Min(X0, X1) - MaxHalfWidth) > fScreenWidth))
+	{
+		Thing->DrawMe = false;
+		++FrameStats.BandCulled[BandIndex];
+		return;
+	}
+	
+	//NOTE(moritz): Lerp the sprite scaling between the base depth line and the next closer one. 
+	//Use depth to determine t.
+	//TODO(moritz): Handle out of bounds!
+	float Depth0 = DepthLines[BasePDepthLineIndex].Depth;
+	float Depth1 = DepthLines[BasePDepthLineIndex + 1].Depth;
+	
+	float DeltaDepth = Depth1     - Depth0;
+	float BasePDelta = BasePDepth - Depth0;
+	
+	float t = BasePDelta/DeltaDepth;
+	
+	//TODO(moritz): Handle out of bounds!
+	float Scale0 = DepthLines[BasePDepthLineIndex].Scale;
+	float Scale1 = DepthLines[BasePDepthLineIndex + 1].Scale;
+	
+	float DepthScale = LerpM(Scale0, t, Scale1);
+	
+	//if(DebugText)
+	//DrawText(TextFormat("TreeDepthScale: %f", DepthScale), 20, 30, 10, RED);
+	
+	//NOTE(moritz): Determine screen position of BaseP
+	float BasePScreenY = fScreenHeight;
+	if(BasePDepth != 0.0f)
+		BasePScreenY = (float)DepthLineCount + (CameraHeight/BasePDepth);
+	
+	//NOTE(moritz):Clamp to screen coords to avoid some invalid memory access bug
+	BasePScreenY = ClampM(0.0f, BasePScreenY, fScreenHeight);
+	
+	//NOTE(moritz): Where the sprite will be at the bottom of the Road
+	//float BasePOffsetX = BaseRoadHalfWidth + 300.0f + 0.5f*((float)Texture.width);
+	
+	//NOTE(moritz): Some more lerping for the X part of BaseP. Taking into account curviness, angle of road and all that nonesense...
+	//float fDepthLineCount = (float)DepthLineCount;
+	
+	Vector2 BaseP = {};
+	BaseP.x = LerpM(X0, t, X1);
+	BaseP.y = BasePScreenY;
+	
+	
+	//NOTE(moritz): Convert from BaseP to draw p... complying with raylib convention
+	Vector2 SpriteDrawP = {};
+	SpriteDrawP.x = BaseP.x - 0.5f*((float)CurrentTexture.width)*DepthScale*SpriteScale*ScaleInT;
+	SpriteDrawP.y = BaseP.y - ((float)CurrentTexture.height)*DepthScale*SpriteScale*ScaleInT + SpriteVerticalTweak*(float)CurrentTexture.height*DepthScale*SpriteScale*ScaleInT;
+	
+#if 0
+	DrawTextureEx(CurrentTexture, SpriteDrawP, 0.0f, DepthScale*SpriteScale*ScaleInT, Thing->Tint/*WHITE*/);
+#endif
+	
+	Thing->FrameBaseP = BaseP;
+	Thing->FramePosition = SpriteDrawP;
+	Thing->FrameScale = DepthScale*SpriteScale*ScaleInT;
+	
+	//NOTE(moritz): LOD, a sprite only a few pixels tall is drawn as a rect of its average color
+	Thing->FrameIsImpostor = (((float)CurrentTexture.height*Thing->FrameScale) < THING_IMPOSTOR_MAX_HEIGHT);
+	if(Thing->FrameIsImpostor)
+		++FrameStats.BandImpostors[BandIndex];
+	else
+		++FrameStats.BandDrawn[BandIndex];
+	
+	if(PickGrid && Billboard->PickMask && (Thing->FrameScale > 0.0f))
+	{
+		Vector2 PickMax = 
+		{
+			SpriteDrawP.x + (float)CurrentTexture.width*Thing->FrameScale,
+			SpriteDrawP.y + (float)CurrentTexture.height*Thing->FrameScale
+		};
+		InsertIntoPickGrid(PickGrid, Thing, SpriteDrawP, PickMax);
+	}
+}
+
+void
+DrawBillboard(billboard *Billboard, thing *Thing)
+{
+	if(!Thing->DrawMe)
+		return;
+	
+	if(Thing->IsDeleted)
+		return;
+	
+	//NOTE(moritz): In case of vehicle either left or right is fine
+	Texture2D CurrentTexture = Billboard->TextureRight;
+	
+	if(Thing->RoadSide == -1.0f)
+		CurrentTexture = Billboard->TextureLeft;
+	else if(Thing->RoadSide == 1.0f)
+		CurrentTexture = Billboard->TextureRight;
+	
+	if(Thing->FrameIsImpostor)
+	{
+		Color ImpostorColor = Billboard->ImpostorColor;
+		ImpostorColor.r = (unsigned char)(((int)ImpostorColor.r*(int)Thing->Tint.r)/255);
+		ImpostorColor.g = (unsigned char)(((int)ImpostorColor.g*(int)Thing->Tint.g)/255);
+		ImpostorColor.b = (unsigned char)(((int)ImpostorColor.b*(int)Thing->Tint.b)/255);
+		ImpostorColor.a = (unsigned char)(((int)ImpostorColor.a*(int)Thing->Tint.a)/255);
+		
+		Vector2 ImpostorSize = {(float)CurrentTexture.width*Thing->FrameScale, (float)CurrentTexture.height*Thing->FrameScale};
+		DrawRectangleV(Thing->FramePosition, ImpostorSize, ImpostorColor);
+	}
+	else
+	{
+		DrawTextureEx(CurrentTexture, Thing->FramePosition, 0.0f, Thing->FrameScale, Thing->Tint);
+	}
+	
+#if 0
+	//NOTE(moritz): Vis for sprite hot spots
+	Vector2 TestSize = {5.0f, 5.0f};
+	DrawRectangleV(Thing->FrameBaseP, TestSize, RED);
+	DrawRectangleV(Thing->FramePosition, TestSize, BLACK);
+#endif
+	
+#if 0
+	//NOTE(moritz): Collision line vis
+	float ColHalfLength = 0.5f*(float)CurrentTexture.width*Thing->FrameScale;
+	Vector2 ColLineStart;
+	ColLineStart.x = Thing->FrameBaseP.x - ColHalfLength;
+	ColLineStart.y = Thing->FrameBaseP.y;
+	Vector2 ColLineEnd;
+	ColLineEnd.x = Thing->FrameBaseP.x + ColHalfLength;
+	ColLineEnd.y = Thing->FrameBaseP.y;
+	DrawLineEx(ColLineStart, ColLineEnd, 2.0f, BROWN);
+#endif
+}
+
+inline void
+InitSegment(road_segment *Segment, road_segment *PrevSegment, random_series *Entropy, float MaxDistance)
+{
+	if(PrevSegment)
+		Segment->Position = PrevSegment->Position + 1.0f;//.2f + 0.5f*RandomUnilateral(Entropy); //NOTE(moritz): Float depth map position
+	
+	//float Rand = RandomBilateral(Entropy)*0.005f;
+	//float SignRand = Sign(Rand);
+	//Segment->ddX      = 0.005f*SignRand + Rand;
+	
+	//Segment->Length   = 25.0f + 80.0f*RandomUnilateral(Entropy);
+	//Segment->EndRelPX = 250.0f*RandomBilateral(Entropy);
+	
+	//Segment->ddX      = 2.0f*(Segment->EndRelPX)/(MaxDistance*(MaxDistance + 1.0f));
+	
+	unsigned int Roll = XORShift32(Entropy);
+	Segment->ddX = RoadPresets[Roll % ArrayCount(RoadPresets)];
+	
+	//NOTE(moritz): Both road models get set up, so they can be switched at any time
+	InitSegmentBezier(Segment, PrevSegment, Roll, MaxDistance);
+}
+
+/*
+NOTE(moritz):
+Segments get generated LANE_WIDTH at a time into a pending list, so one batched
+SetRoadSegmentLUTs call fills all lanes. Each one gets handed out when the road needs it.
+The pending chain starts at the current last segment, so the curve stays continuous
+and the entropy gets rolled in the same order as before.
+*/
+road_segment *
+NextRoadSegment(road_pool *Pool, road_list *PendingRoadList, road_segment *PrevSegment,
+				random_series *Entropy, float MaxDistance)
+{
+	if(!PendingRoadList->First)
+	{
+		road_segment *Batch[LANE_WIDTH];
+		road_segment *Prev = PrevSegment;
+		
+		for(int SegmentIndex = 0;
+			SegmentIndex < LANE_WIDTH;
+			++SegmentIndex)
+		{
+			road_segment *Segment = AllocateRoadSegment(Pool);
+			InitSegment(Segment, Prev, Entropy, MaxDistance);
+			Append(PendingRoadList, Segment);
+			
+			Batch[SegmentIndex] = Prev = Segment;
+		}
+		
+		SetRoadSegmentLUTs(Batch, LANE_WIDTH);
+	}
+	
+	road_segment *Result = PendingRoadList->First;
+	PendingRoadList->First = Result->Next;
+	if(!PendingRoadList->First)
+		PendingRoadList->Last = 0;
+	
+	//NOTE(moritz): Position was relative to the list at generation time, the road has scrolled since
+	Result->Position = PrevSegment->Position + 1.0f;
+	Result->Next = 0;
+	
+	return(Result);
+}
+
+
+/*
+NOTE(moritz):
+1-bit alpha masks for picking. Level 0 is the image thresholded at half alpha, every further
+level box-filters the alpha of the previous one down by 2 and thresholds again (same as a
+mipmap would look). A query picks the level where a screen pixel covers about one texel,
+so a hit test is a single bit lookup no matter how small the sprite is drawn.
+*/
+#define ALPHA_MASK_MAX_LEVELS 8
+#define ALPHA_MASK_THRESHOLD 128
+
+struct alpha_mask_level
+{
+	int Width;
+	int Height;
+	int Pitch; //NOTE(moritz): In 32-bit words
+	unsigned int *Bits;
+};
+
+struct alpha_mask
+{
+	int Width;
+	int Height;
+	
+	int LevelCount;
+	alpha_mask_level Levels[ALPHA_MASK_MAX_LEVELS];
+};
+
+void
+BuildAlphaMask(alpha_mask *Mask, Image Source)
+{
+	Mask->Width  = Source.width;
+	Mask->Height = Source.height;
+	Mask->LevelCount = 0;
+	
+	int Width  = Source.width;
+	int Height = Source.height;
+	
+	unsigned char *Alpha = (unsigned char *)malloc(Width*Height);
+	
+	Color *Colors = LoadImageColors(Source);
+	for(int PixelIndex = 0;
+		PixelIndex < (Width*Height);
+		++PixelIndex)
+	{
+		Alpha[PixelIndex] = Colors[PixelIndex].a;
+	}
+	UnloadImageColors(Colors);
+	
+	while(Mask->LevelCount < ALPHA_MASK_MAX_LEVELS)
+	{
+		alpha_mask_level *Level = Mask->Levels + Mask->LevelCount++;
+		Level->Width  = Width;
+		Level->Height = Height;
+		Level->Pitch  = (Width + 31)/32;
+		Level->Bits   = (unsigned int *)malloc(sizeof(unsigned int)*Level->Pitch*Height);
+		ZeroSize(Level->Bits, sizeof(unsigned int)*Level->Pitch*Height);
+		
+		for(int Y = 0;
+			Y < Height;
+			++Y)
+		{
+			unsigned int *Row = Level->Bits + Y*Level->Pitch;
+			for(int X = 0;
+				X < Width;
+				++X)
+			{
+				if(Alpha[Y*Width + X] >= ALPHA_MASK_THRESHOLD)
+					Row[X/32] |= (1u << (X % 32));
+			}
+		}
+		
+		if((Width == 1) && (Height == 1))
+			break;
+		
+		//NOTE(moritz): Next level, odd edges get clamped
+		int NextWidth  = (Width  > 1) ? Width/2  : 1;
+		int NextHeight = (Height > 1) ? Height/2 : 1;
+		
+		for(int Y = 0;
+			Y < NextHeight;
+			++Y)
+		{
+			int Y0 = 2*Y;
+			int Y1 = (2*Y + 1 < Height) ? (2*Y + 1) : Y0;
+			for(int X = 0;
+				X < NextWidth;
+				++X)
+			{
+				int X0 = 2*X;
+				int X1 = (2*X + 1 < Width) ? (2*X + 1) : X0;
+				
+				int Sum = Alpha[Y0*Width + X0] + Alpha[Y0*Width + X1] + Alpha[Y1*Width + X0] + Alpha[Y1*Width + X1];
+				
+				//NOTE(moritz): Written in place, never ahead of what is still to be read
+				Alpha[Y*NextWidth + X] = (unsigned char)((Sum + 2)/4);
+			}
+		}
+		
+		Width  = NextWidth;
+		Height = NextHeight;
+	}
+	
+	free(Alpha);
+}
+
+/*
+NOTE(moritz):
+Pick mask for a billboard that only ships as baked mips. Level 0 of the chain gets used,
+scaled to the layout size when the baker padded it, since picking works in layout texels.
+*/
+void
+BuildBillboardAlphaMask(alpha_mask *Mask, const char *FileName)
+{
+	asset_job Scratch;
+	asset_job *Job = BeginAssetLoad(&AssetLoader, &Scratch, FileName, AssetJob_BillboardTexture);
+	
+	if(Job->Pixels.data)
+	{
+		Image Level0 = Job->Pixels;
+		Level0.mipmaps = 1;
+		
+		if((Level0.width != Job->LayoutWidth) || (Level0.height != Job->LayoutHeight))
+		{
+			Image Resized = ImageCopy(Level0);
+			ImageResize(&Resized, Job->LayoutWidth, Job->LayoutHeight);
+			BuildAlphaMask(Mask, Resized);
+			UnloadImage(Resized);
+		}
+		else
+		{
+			BuildAlphaMask(Mask, Level0);
+		}
+	}
+	
+	ReleaseAssetJob(Job);
+}
+
+//NOTE(moritz): P is in level 0 texels, Scale is how many screen pixels one level 0 texel covers
+bool
+AlphaMaskTest(alpha_mask *Mask, Vector2 P, float Scale)
+{
+	if((P.x < 0.0f) || (P.y < 0.0f) ||
+	   (P.x >= (float)Mask->Width) || (P.y >= (float)Mask->Height))
+		return(false);
+	
+	int LevelIndex = 0;
+	while((Scale < 0.5f) && (LevelIndex < (Mask->LevelCount - 1)))
+	{
+		Scale *= 2.0f;
+		++LevelIndex;
+	}
+	
+	alpha_mask_level *Level = Mask->Levels + LevelIndex;
+	int X = (int)P.x >> LevelIndex;
+	int Y = (int)P.y >> LevelIndex;
+	if(X >= Level->Width)
+		X = Level->Width - 1;
+	if(Y >= Level->Height)
+		Y = Level->Height - 1;
+	
+	bool Result = (Level->Bits[Y*Level->Pitch + X/32] >> (X % 32)) & 1;
+	return(Result);
+}
+
+//NOTE(moritz): Front-most thing whose sprite rect and pick mask contain the screen point P, 0 if none
+thing *
+PickThing(pick_grid *Grid, Vector2 P)
+{
+	int CellX = (int)floorf(P.x*(1.0f/PICK_GRID_CELL_SIZE));
+	int CellY = (int)floorf(P.y*(1.0f/PICK_GRID_CELL_SIZE));
+	
+	if((CellX < 0) || (CellY < 0) ||
+	   (CellX >= Grid->CellsX) || (CellY >= Grid->CellsY))
+		return(0);
+	
+	for(int EntryIndex = Grid->CellFirst[CellY*Grid->CellsX + CellX];
+		EntryIndex >= 0;
+		EntryIndex = Grid->Entries[EntryIndex].Next)
+	{
+		thing *Thing = Grid->Entries[EntryIndex].Thing;
+		
+		if(!Thing->DrawMe || Thing->IsDeleted)
+			continue;
+		
+		Vector2 TexelP = (P - Thing->FramePosition)*(1.0f/Thing->FrameScale);
+		if(AlphaMaskTest(Thing->Billboard->PickMask, TexelP, Thing->FrameScale))
+			return(Thing);
+	}
+	
+	return(0);
+}
+
+/* NOTE(moritz):
+Sky gradient and dithered horizon look the same every frame, except for the horizon's wobble.
+That one only ever moves by whole pixels (DrawTexture takes ints), so there are just a handful of
+different pictures. The cache renders all of them once, stacked as bands in one render texture,
+and the frame copies the band for the current wobble instead of drawing gradient and horizon.
+It gets rebuilt when the resolution changes or IsValid gets cleared (e.g. after reloading assets).
+
+Sunset and skyline stay live on top, they pan at different speeds than each other, so no single
+cached picture can stand in for them. The skyline is one shader pass already anyway.
+*/
+
+struct background_cache
+{
+	bool IsValid;
+	RenderTexture2D Target;
+	
+	int Width;
+	int ScreenHeight;
+	int BandHeight;
+	int WobbleAmplitude; //NOTE(moritz): In pixels, band i has the horizon moved by i - WobbleAmplitude
+};
+
+void
+BuildBackgroundCache(background_cache *Cache, int ScreenWidth, int ScreenHeight, Color SkyColor0, Color SkyColor1,
+					 Texture2D HorizonTexture, Vector2 HorizonP, int WobbleAmplitude)
+{
+	if(Cache->Target.id)
+		UnloadRenderTexture(Cache->Target);
+	
+	//NOTE(moritz): Down to wherever the horizon can reach
+	int BandHeight = (int)ceilf(HorizonP.y) + HorizonTexture.height + WobbleAmplitude;
+	if(BandHeight < ScreenHeight/2)
+		BandHeight = ScreenHeight/2;
+	if(BandHeight > ScreenHeight)
+		BandHeight = ScreenHeight;
+	
+	int BandCount = 2*WobbleAmplitude + 1;
+	
+	Cache->Width           = ScreenWidth;
+	Cache->ScreenHeight    = ScreenHeight;
+	Cache->BandHeight      = BandHeight;
+	Cache->WobbleAmplitude = WobbleAmplitude;
+	Cache->Target          = LoadRenderTexture(ScreenWidth, BandCount*BandHeight);
+	
+	//NOTE(moritz): Exactly what the frame used to draw: clear, sky gradient, horizon
+	BeginTextureMode(Cache->Target);
+	ClearBackground(PINK);
+	for(int BandIndex = 0;
+		BandIndex < BandCount;
+		++BandIndex)
+	{
+		int BandTop = BandIndex*BandHeight;
+		DrawRectangleGradientV(0, BandTop, ScreenWidth, ScreenHeight/2, SkyColor0, SkyColor1);
+		
+		Vector2 BandHorizonP = {HorizonP.x, HorizonP.y + (float)(BandTop + BandIndex - WobbleAmplitude)};
+		DrawTextureV(HorizonTexture, BandHorizonP, WHITE);
+	}
+	EndTextureMode();
+	
+	Cache->IsValid = true;
+}
+
+//NOTE(moritz): Covers the top BandHeight rows completely, whatever was there before
+void
+DrawBackgroundCache(background_cache *Cache, int Wobble)
+{
+	int BandIndex = Wobble + Cache->WobbleAmplitude;
+	if(BandIndex < 0)
+		BandIndex = 0;
+	if(BandIndex > 2*Cache->WobbleAmplitude)
+		BandIndex = 2*Cache->WobbleAmplitude;
+	
+	//NOTE(moritz): Render textures are upside down, hence counting from the bottom and the negative height
+	float TextureHeight = (float)Cache->Target.texture.height;
+	Rectangle Source = {0.0f, TextureHeight - (float)((BandIndex + 1)*Cache->BandHeight),
+		(float)Cache->Width, -(float)Cache->BandHeight};
+	
+	//NOTE(moritz): Straight copy, the horizon's alpha is baked in already and mustn't get blended twice
+	rlSetBlendFactors(RL_ONE, RL_ZERO, RL_FUNC_ADD);
+	BeginBlendMode(BLEND_CUSTOM);
+	DrawTextureRec(Cache->Target.texture, Source, {0.0f, 0.0f}, WHITE);
+	EndBlendMode();
+}
+
+/* NOTE(moritz):
+The five skyline layers are stacked into one atlas texture and skyline.fs composites all of them
+in a single quad: per layer it wraps the u coordinate by that layer's pan and blends back to front.
+So the parallax is one draw call no matter how wide the screen is.
+The wrapping happens in the shader with fract, the textures are 576 wide and WebGL1 can't
+TEXTURE_WRAP_REPEAT non power of two textures (that's why SetTextureWrap didn't work out).
+If the shader doesn't load, every layer gets drawn from the atlas with as few copies as cover the screen.
+*/
+
+#define SKYLINE_LAYER_COUNT 5
+
+struct _Skyline {
+	Texture2D loadAtlas(const char *fileNames[SKYLINE_LAYER_COUNT]) {
+		Image layers[SKYLINE_LAYER_COUNT];
+		for(int i = 0; i < SKYLINE_LAYER_COUNT; ++i)
+			layers[i] = LoadImageAsset(fileNames[i]);
+		
+		layerW = (float)layers[0].width;
+		layerH = (float)layers[0].height;
+		
+		//NOTE(moritz): Layer i at y = i*layerH, back to front
+		Image atlas = GenImageColor(layers[0].width, SKYLINE_LAYER_COUNT*layers[0].height, BLANK);
+		for(int i = 0; i < SKYLINE_LAYER_COUNT; ++i) {
+			const Rectangle source = {0, 0, (float)layers[i].width, (float)layers[i].height};
+			const Rectangle dest = {0, i*layerH, layerW, layerH};
+			ImageDraw(&atlas, layers[i], source, dest, WHITE);
+			UnloadImage(layers[i]);
+		}
+		
+		Texture2D texture = LoadTextureFromImage(atlas);
+		UnloadImage(atlas);
+		
+		return texture;
+	}
+	
+	const float panning[5] = {1.f/10, 1.f/8, 1.f/6, 1.f/4, 1.f/2};
+	const float pan_min = 1;
+	const float pan_max = 100;
+	
+	const char *layerFileNames[SKYLINE_LAYER_COUNT] = {"city0.png", "city1.png", "city2.png", "city3.png", "city4.png"};
+	
+	float layerW = 0, layerH = 0;
+	Texture2D atlas = loadAtlas(layerFileNames);
+	
+	Shader shader = LoadShader(0, "skyline.fs");
+	int offsetsLoc = GetShaderLocation(shader, "layerOffsets");
+	bool hasShader = (shader.id != rlGetShaderIdDefault()) && (offsetsLoc >= 0);
+	
+	const float y = -50;
+	
+	const float screenW, screenH;
+	_Skyline(const float screenW, const float screenH) : screenW(screenW), screenH(screenH) { };
+	
+	//NOTE(moritz): For the fill rate stats, what one layer covers on screen
+	int layerPixelCount() {
+		return RectPixelCount({0, y, screenW, layerH}, screenW, screenH);
+	}
+	
+	float getPanFactor(float z_min, float z_max, float t) {
+		return 1.f / LerpM(1.f/z_min, t, 1.f/z_max);
+	}
+	
+	//NOTE(moritz): Where the layer's copies start, in [0, layerW)
+	float getLayerOffset(int i, float accumulated_velocity) {
+		const float pan_factor = getPanFactor(pan_min, pan_max, (float)i/5.);
+		float offset = fmodf(pan_factor * accumulated_velocity, layerW);
+		if(offset < 0)
+			offset += layerW;
+		return offset;
+	}
+	
+	void draw(float delta_time, float accumulated_velocity) {
+		if(hasShader) {
+			//NOTE(moritz): In layer widths, that's what the u coordinate counts in
+			float offsets[SKYLINE_LAYER_COUNT];
+			for(int i = 0; i < SKYLINE_LAYER_COUNT; ++i)
+				offsets[i] = getLayerOffset(i, accumulated_velocity) / layerW;
+			
+			BeginShaderMode(shader);
+			SetShaderValueV(shader, offsetsLoc, offsets, SHADER_UNIFORM_FLOAT, SKYLINE_LAYER_COUNT);
+			const Rectangle source = {0, 0, screenW, layerH};
+			const Rectangle dest = {0, y, screenW, layerH};
+			DrawTexturePro(atlas, source, dest, {0, 0}, 0, WHITE);
+			EndShaderMode();
+		} else {
+			for(int i = 0; i < SKYLINE_LAYER_COUNT; ++i) {
+				const Rectangle source = {0, i*layerH, layerW, layerH};
+				for(float x = getLayerOffset(i, accumulated_velocity) - layerW; x < screenW; x += layerW)
+					DrawTextureRec(atlas, source, {x, y}, WHITE);
+			}
+		}
+	}
+};
+
+/*
+NOTE(moritz):
+Segment P1-P2 against segment P3-P4. Instead of dividing the numerators by the denominator
+and checking 0 <= t <= 1, the numerators get compared against the denominator directly
+(after flipping all three to make the denominator positive). Same answer, no division,
+and it is what the batched version does lane by lane, so both agree exactly
+(as long as the compiler doesn't contract them into FMAs, see CMakeLists.txt).
+*/
+bool
+LineLineIntersect(Vector2 P1, Vector2 P2,
+				  Vector2 P3, Vector2 P4)
+{
+	float Denom = (P4.y - P3.y)*(P2.x - P1.x) - (P4.x - P3.x)*(P2.y - P1.y);
+	
+	float NumA = (P4.x - P3.x)*(P1.y - P3.y) - (P4.y - P3.y)*(P1.x - P3.x);
+	
+	float NumB = (P2.x - P1.x)*(P1.y - P3.y) - (P2.y - P1.y)*(P1.x - P3.x);
+	
+	if(Denom < 0.0f)
+	{
+		Denom = -Denom;
+		NumA  = -NumA;
+		NumB  = -NumB;
+	}
+	
+	bool Result = 
+	(Denom > 0.0f) &&
+	(NumA >= 0.0f) && 
+	(NumA <= Denom) &&
+	(NumB >= 0.0f) &&
+	(NumB <= Denom);
+	
+	return(Result);
+}
+
+//NOTE(moritz): Segments stored SoA, so the batched intersection can load LANE_WIDTH of them at once
+struct segment_soa
+{
+	int Count;
+	int Capacity;
+	
+	float *StartX;
+	float *StartY;
+	float *EndX;
+	float *EndY;
+};
+
+inline void
+PushSegment(segment_soa *Segments, Vector2 Start, Vector2 End)
+{
+	if(Segments->Count < Segments->Capacity)
+	{
+		int Index = Segments->Count++;
+		Segments->StartX[Index] = Start.x;
+		Segments->StartY[Index] = Start.y;
+		Segments->EndX[Index]   = End.x;
+		Segments->EndY[Index]   = End.y;
+	}
+}
+
+/*
+NOTE(moritz):
+Segment P1-P2 against all segments in Segments. Bit I of HitMask (32 per word) is set when
+segment I intersects. HitMask needs (Count + 31)/32 words.
+*/
+void
+LineLineIntersectBatch(Vector2 P1, Vector2 P2, segment_soa *Segments, unsigned int *HitMask)
+{
+	int Count = Segments->Count;
+	
+	for(int WordIndex = 0;
+		WordIndex < ((Count + 31)/32);
+		++WordIndex)
+	{
+		HitMask[WordIndex] = 0;
+	}
+	
+	lane_f32 P1x = LaneF32(P1.x);
+	lane_f32 P1y = LaneF32(P1.y);
+	lane_f32 Dx  = LaneF32(P2.x - P1.x);
+	lane_f32 Dy  = LaneF32(P2.y - P1.y);
+	
+	lane_f32 Zero = LaneF32(0.0f);
+	lane_f32 SignBit = LaneF32(-0.0f);
+	
+	int SegmentIndex = 0;
+	for(;
+		(SegmentIndex + LANE_WIDTH) <= Count;
+		SegmentIndex += LANE_WIDTH)
+	{
+		lane_f32 P3x = LaneLoad(Segments->StartX + SegmentIndex);
+		lane_f32 P3y = LaneLoad(Segments->StartY + SegmentIndex);
+		lane_f32 Ex  = LaneSub(LaneLoad(Segments->EndX + SegmentIndex), P3x);
+		lane_f32 Ey  = LaneSub(LaneLoad(Segments->EndY + SegmentIndex), P3y);
+		
+		lane_f32 Ox  = LaneSub(P1x, P3x);
+		lane_f32 Oy  = LaneSub(P1y, P3y);
+		
+		lane_f32 Denom = LaneSub(LaneMul(Ey, Dx), LaneMul(Ex, Dy));
+		lane_f32 NumA  = LaneSub(LaneMul(Ex, Oy), LaneMul(Ey, Ox));
+		lane_f32 NumB  = LaneSub(LaneMul(Dx, Oy), LaneMul(Dy, Ox));
+		
+		//NOTE(moritz): Make the denominator positive, flip the numerators along with it
+		lane_f32 DenomSign = LaneAnd(Denom, SignBit);
+		Denom = LaneXor(Denom, DenomSign);
+		NumA  = LaneXor(NumA,  DenomSign);
+		NumB  = LaneXor(NumB,  DenomSign);
+		
+		lane_f32 Hit = LaneGreater(Denom, Zero);
+		Hit = LaneAnd(Hit, LaneGreaterEqual(NumA, Zero));
+		Hit = LaneAnd(Hit, LaneGreaterEqual(Denom, NumA));
+		Hit = LaneAnd(Hit, LaneGreaterEqual(NumB, Zero));
+		Hit = LaneAnd(Hit, LaneGreaterEqual(Denom, NumB));
+		
+		unsigned int LaneHits = LaneMask(Hit);
+		for(int Lane = 0;
+			Lane < LANE_WIDTH;
+			++Lane)
+		{
+			if(LaneHits & (1u << Lane))
+			{
+				int HitIndex = SegmentIndex + Lane;
+				HitMask[HitIndex/32] |= (1u << (HitIndex % 32));
+			}
+		}
+	}
+	
+	//NOTE(moritz): Leftovers
+	for(;
+		SegmentIndex < Count;
+		++SegmentIndex)
+	{
+		Vector2 P3 = {Segments->StartX[SegmentIndex], Segments->StartY[SegmentIndex]};
+		Vector2 P4 = {Segments->EndX[SegmentIndex], Segments->EndY[SegmentIndex]};
+		
+		if(LineLineIntersect(P1, P2, P3, P4))
+			HitMask[SegmentIndex/32] |= (1u << (SegmentIndex % 32));
+	}
+}
+
+/*
+NOTE(moritz):
+Thing store. Things live in fixed-size blocks that get allocated as the store grows, so a thing
+never moves once it is spawned and its ID (the slot index) gets straight to it. Capacity is the
+hard cap, the overflow policy decides what a spawn past it does. Spawning reuses deleted slots
+first. SortedThings holds every slot handed out so far, kept back to front for drawing.
+*/
+#define THING_BLOCK_SIZE     256
+#define THING_STORE_CAPACITY 8192
+
+//NOTE(moritz): Gameplay budgets inside the store
+#define MAX_ALIENS        64
+#define MAX_ALIEN_BULLETS 2048
+
+enum thing_overflow_policy
+{
+	ThingOverflow_Refuse,          //NOTE(moritz): The spawn fails
+	ThingOverflow_RecycleFarthest, //NOTE(moritz): The farthest live bullet gets taken over
+};
+
+struct thing_block
+{
+	thing Things[THING_BLOCK_SIZE];
+};
+
+struct thing_store
+{
+	int Capacity;
+	thing_overflow_policy OverflowPolicy;
+	
+	int BlockCount;
+	thing_block **Blocks;
+	
+	int Count; //NOTE(moritz): Slots handed out so far, deleted ones included
+	int FirstFreeID;
+	
+	thing **SortedThings;
+	
+	int OverflowCount;
+};
+
+void
+InitThingStore(thing_store *Store, int Capacity, thing_overflow_policy OverflowPolicy)
+{
+	int MaxBlockCount = (Capacity + THING_BLOCK_SIZE - 1)/THING_BLOCK_SIZE;
+	
+	Store->Capacity = Capacity;
+	Store->OverflowPolicy = OverflowPolicy;
+	Store->BlockCount = 0;
+	Store->Blocks = (thing_block **)malloc(sizeof(thing_block *)*MaxBlockCount);
+	Store->Count = 0;
+	Store->FirstFreeID = -1;
+	Store->SortedThings = (thing **)malloc(sizeof(thing *)*Capacity);
+	Store->OverflowCount = 0;
+}
+
+inline thing *
+GetThing(thing_store *Store, int ID)
+{
+	thing *Result = Store->Blocks[ID/THING_BLOCK_SIZE]->Things + (ID % THING_BLOCK_SIZE);
+	return(Result);
+}
+
+//NOTE(moritz): Wipes a thing for reuse. The ID stays, it is the thing's handle in the collision grid.
+inline void
+ResetThing(thing *Thing)
+{
+	int ID = Thing->ID;
+	*Thing = {};
+	Thing->ID = ID;
+}
+
+thing *
+SpawnThing(thing_store *Store)
+{
+	thing *Result = 0;
+	if(Store->FirstFreeID >= 0)
+	{
+		Result = GetThing(Store, Store->FirstFreeID);
+		Store->FirstFreeID = Result->NextIDInFreeList;
+		ResetThing(Result);
+	}
+	else if(Store->Count < Store->Capacity)
+	{
+		int ID = Store->Count++;
+		
+		if((ID/THING_BLOCK_SIZE) >= Store->BlockCount)
+		{
+			thing_block *NewBlock = (thing_block *)malloc(sizeof(thing_block));
+			ZeroSize(NewBlock, sizeof(thing_block));
+			Store->Blocks[Store->BlockCount++] = NewBlock;
+		}
+		
+		Result = GetThing(Store, ID);
+		Result->ID = ID;
+		Store->SortedThings[ID] = Result;
+	}
+	else
+	{
+		++Store->OverflowCount;
+		
+		if(Store->OverflowPolicy == ThingOverflow_RecycleFarthest)
+		{
+			for(int SortIndex = 0;
+				SortIndex < Store->Count;
+				++SortIndex)
+			{
+				thing *Candidate = Store->SortedThings[SortIndex];
+				if(Candidate->IsBullet && !Candidate->IsDeleted)
+				{
+					Result = Candidate;
+					ResetThing(Result);
+					break;
+				}
+			}
+		}
+	}
+	
+	return(Result);
+}
+
+void
+DeleteThing(thing_store *Store, thing *Thing)
+{
+	Thing->IsDeleted = true;
+	
+	Thing->NextIDInFreeList = Store->FirstFreeID;
+	Store->FirstFreeID = Thing->ID;
+}
+
+enum bullet_pattern
+{
+	BulletPattern_Single, //NOTE(moritz): One bullet straight at the road
+	BulletPattern_Spread, //NOTE(moritz): Three side by side
+	BulletPattern_Burst,  //NOTE(moritz): Three in quick succession
+};
+
+/*
+NOTE(moritz):
+Enemy waves. The schedule runs on its own clock. Every entry spawns its aliens once when the clock
+passes StartTime. After the last entry the clock jumps back to the second one, the first
+entry (the original lone alien, which never leaves) only spawns once.
+*/
+struct wave
+{
+	float StartTime; //NOTE(moritz): Seconds into the schedule
+	int AlienCount;
+	bullet_pattern Pattern;
+	float FireInterval;
+	float Lifetime;
+};
+
+global wave WaveSchedule[] =
+{
+	{ 0.0f, 1, BulletPattern_Single, 1.0f, F32Max},
+	{20.0f, 2, BulletPattern_Spread, 2.0f, 20.0f},
+	{45.0f, 3, BulletPattern_Burst,  2.5f, 25.0f},
+	{75.0f, 4, BulletPattern_Single, 1.0f, 20.0f},
+};
+#define WAVE_SCHEDULE_LENGTH 100.0f
+
+//NOTE(moritz): Stress scenario (F4): 50 aliens at 10 bullets per second each, on top of the schedule
+global wave StressWave = {0.0f, 50, BulletPattern_Single, 0.1f, F32Max};
+#define STRESS_WAVE_INDEX ArrayCount(WaveSchedule)
+#define STRESS_LOG_INTERVAL 2.0f
+
+#define WAVE_COLUMNS        7
+#define WAVE_COLUMN_SPACING 120.0f
+#define WAVE_ROW_SPACING    1.0f
+
+struct wave_state
+{
+	float Time;
+	int NextWave;
+	
+	bool Stress;
+	float StressLogTimer;
+	
+	//NOTE(moritz): Live counts, recounted every tick and bumped on spawn
+	int AlienCount;
+	int BulletCount;
+	int RefusedSpawnCount;
+};
+
+void
+SpawnAlien(wave_state *Waves, wave *Wave, int WaveIndex, int IndexInWave,
+		   thing_store *Store,
+		   billboard *AlienBillboard)
+{
+	thing *Alien = 0;
+	if(Waves->AlienCount < MAX_ALIENS)
+		Alien = SpawnThing(Store);
+	
+	if(!Alien)
+	{
+		++Waves->RefusedSpawnCount;
+		return;
+	}
+	
+	++Waves->AlienCount;
+	
+	//NOTE(moritz): Lined up in rows across the road, each row hovering a bit closer
+	int ColumnCount = (Wave->AlienCount < WAVE_COLUMNS) ? Wave->AlienCount : WAVE_COLUMNS;
+	int Column = IndexInWave % WAVE_COLUMNS;
+	int Row    = IndexInWave / WAVE_COLUMNS;
+	
+	Alien->IsAlien   = true;
+	Alien->Billboard = AlienBillboard;
+	Alien->Tint      = WHITE;
+	Alien->Speed     = 10.0f;
+	Alien->XOffset   = ((float)Column - 0.5f*(float)(ColumnCount - 1))*WAVE_COLUMN_SPACING;
+	Alien->HoverDistance = Max(10.0f - (float)Row*WAVE_ROW_SPACING, 3.5f);
+	Alien->Distance      = Alien->HoverDistance;
+	Alien->PrevDistance  = Alien->Distance;
+	
+	Alien->BulletPattern = Wave->Pattern;
+	Alien->FireInterval  = Wave->FireInterval;
+	Alien->ShootTimer    = Wave->FireInterval*(1.0f + 0.125f*(float)(IndexInWave % 8));
+	Alien->Lifetime      = Wave->Lifetime;
+	Alien->WaveIndex     = WaveIndex;
+}
+
+void
+SpawnWave(wave_state *Waves, wave *Wave, int WaveIndex,
+		  thing_store *Store,
+		  billboard *AlienBillboard)
+{
+	for(int IndexInWave = 0;
+		IndexInWave < Wave->AlienCount;
+		++IndexInWave)
+	{
+		SpawnAlien(Waves, Wave, WaveIndex, IndexInWave,
+				   Store, AlienBillboard);
+	}
+}
+
+void
+DespawnWave(wave_state *Waves, int WaveIndex, thing_store *Store)
+{
+	for(int ID = 0;
+		ID < Store->Count;
+		++ID)
+	{
+		thing *Thing = GetThing(Store, ID);
+		if(!Thing->IsDeleted && Thing->IsAlien && (Thing->WaveIndex == WaveIndex))
+		{
+			DeleteThing(Store, Thing);
+			--Waves->AlienCount;
+		}
+	}
+}
+
+void
+UpdateWaves(wave_state *Waves, float dt,
+			thing_store *Store,
+			billboard *AlienBillboard)
+{
+	Waves->Time += dt;
+	
+	while((Waves->NextWave < (int)ArrayCount(WaveSchedule)) &&
+		  (Waves->Time >= WaveSchedule[Waves->NextWave].StartTime))
+	{
+		SpawnWave(Waves, WaveSchedule + Waves->NextWave, Waves->NextWave,
+				  Store, AlienBillboard);
+		++Waves->NextWave;
+	}
+	
+	if(Waves->Time >= WAVE_SCHEDULE_LENGTH)
+	{
+		Waves->Time -= WAVE_SCHEDULE_LENGTH - WaveSchedule[1].StartTime;
+		Waves->NextWave = 1;
+	}
+}
+
+void
+FireAlienBullet(wave_state *Waves, thing *Alien, float XOffset,
+				thing_store *Store,
+				billboard *BulletBillboard)
+{
+	thing *NewBullet = 0;
+	if(Waves->BulletCount < MAX_ALIEN_BULLETS)
+		NewBullet = SpawnThing(Store);
+	
+	if(!NewBullet)
+	{
+		++Waves->RefusedSpawnCount;
+		return;
+	}
+	
+	++Waves->BulletCount;
+	
+	NewBullet->IsBullet = true;
+	NewBullet->Distance = Alien->Distance;
+	NewBullet->PrevDistance = NewBullet->Distance;
+	NewBullet->XOffset  = Alien->XOffset + XOffset;
+	NewBullet->Speed    = -5.0f;
+	NewBullet->Billboard = BulletBillboard;
+	NewBullet->Tint      = WHITE;
+}
+
+void
+UpdateAlienShooting(wave_state *Waves, thing *Alien, float dt,
+					thing_store *Store,
+					billboard *BulletBillboard)
+{
+	Alien->ShootTimer -= dt;
+	
+	if(Alien->ShootTimer >= 0.0f)
+		return;
+	
+	Alien->ShootTimer = Alien->FireInterval;
+	
+	switch(Alien->BulletPattern)
+	{
+		case BulletPattern_Single:
+		{
+			FireAlienBullet(Waves, Alien, 0.0f, Store, BulletBillboard);
+		} break;
+		
+		case BulletPattern_Spread:
+		{
+			for(int Shot = -1;
+				Shot <= 1;
+				++Shot)
+			{
+				FireAlienBullet(Waves, Alien, 150.0f*(float)Shot, Store, BulletBillboard);
+			}
+		} break;
+		
+		case BulletPattern_Burst:
+		{
+			FireAlienBullet(Waves, Alien, 0.0f, Store, BulletBillboard);
+			
+			if(++Alien->PatternStep < 3)
+				Alien->ShootTimer = 0.15f;
+			else
+				Alien->PatternStep = 0;
+		} break;
+	}
+}
+
+/*
+NOTE(moritz):
+Scenery streaming. Every band on either side of the road has its own random series, seeded from
+the road seed, and a distance where its next object goes. Objects get spawned while that distance
+is inside the look-ahead window (just past the view distance, where billboards scale in) and
+retired once they pass the camera. So the live set only depends on view distance and band density.
+*/
+#define SCENERY_BAND_COUNT (THING_BAND_COUNT - 1)
+#define SCENERY_LOOKAHEAD_MARGIN 5.0f
+
+struct scenery_band
+{
+	float MinSpacing;
+	float SpacingRange;
+	
+	float XOffset; //NOTE(moritz): Away from the road, mirrored on the left side
+	float XOffsetJitter;
+	
+	billboard *Billboards[2]; //NOTE(moritz): Picked 50/50
+};
+
+struct scenery_stream
+{
+	random_series Entropy;
+	float NextSpawnDistance;
+};
+
+struct scenery
+{
+	float LookAheadDistance;
+	
+	scenery_band Bands[SCENERY_BAND_COUNT];
+	scenery_stream Streams[SCENERY_BAND_COUNT][2]; //NOTE(moritz): Left, right
+};
+
+void
+InitScenery(scenery *Scenery, unsigned int RoadSeed, float MaxDistance)
+{
+	Scenery->LookAheadDistance = MaxDistance + SCENERY_LOOKAHEAD_MARGIN;
+	
+	for(int BandIndex = 0;
+		BandIndex < SCENERY_BAND_COUNT;
+		++BandIndex)
+	{
+		for(int SideIndex = 0;
+			SideIndex < 2;
+			++SideIndex)
+		{
+			scenery_stream *Stream = Scenery->Streams[BandIndex] + SideIndex;
+			
+			//NOTE(moritz): XORShift state must not be 0
+			random_series SeedSeries = {RoadSeed ^ (0x9E3779B9u*(unsigned int)(2*BandIndex + SideIndex + 1))};
+			Stream->Entropy.State = XORShift32(&SeedSeries) | 1;
+			Stream->NextSpawnDistance = 0.0f;
+		}
+	}
+}
+
+//NOTE(moritz): dDistance is how far the camera moved forward this tick
+void
+StreamScenery(scenery *Scenery, thing_store *Store, float dDistance)
+{
+	for(int BandIndex = 0;
+		BandIndex < SCENERY_BAND_COUNT;
+		++BandIndex)
+	{
+		scenery_band *Band = Scenery->Bands + BandIndex;
+		
+		for(int SideIndex = 0;
+			SideIndex < 2;
+			++SideIndex)
+		{
+			scenery_stream *Stream = Scenery->Streams[BandIndex] + SideIndex;
+			float RoadSide = SideIndex ? 1.0f : -1.0f;
+			
+			Stream->NextSpawnDistance -= dDistance;
+			
+			while(Stream->NextSpawnDistance < Scenery->LookAheadDistance)
+			{
+				float Distance = Stream->NextSpawnDistance;
+				Stream->NextSpawnDistance += Band->MinSpacing + Band->SpacingRange*RandomUnilateral(&Stream->Entropy);
+				
+				float XOffset = Band->XOffset + Band->XOffsetJitter*RandomBilateral(&Stream->Entropy);
+				billboard *Billboard = Band->Billboards[(RandomUnilateral(&Stream->Entropy) < 0.5f) ? 0 : 1];
+				
+				//NOTE(moritz): Spawned behind the camera after a big jump, nothing to see there
+				if(Distance < 0.0f)
+					continue;
+				
+				thing *Thing = SpawnThing(Store);
+				if(!Thing)
+					continue;
+				
+				Thing->BandIndex = BandIndex + 1;
+				Thing->RoadSide  = RoadSide;
+				Thing->Distance  = Distance;
+				Thing->PrevDistance = Distance;
+				Thing->XOffset   = RoadSide*XOffset;
+				Thing->Billboard = Billboard;
+				Thing->Tint      = WHITE;
+			}
+		}
+	}
+}
+
+/*
+NOTE(moritz):
+Collision broad-phase. Uniform grid over world distance x lateral offset from the road center
+(in pixels at the bottom depth line, where the depth scale is 1). Things are tracked by ID,
+their slot in the thing store. Every tick only the things that changed cell
+get relinked, and a query only touches the cells around the player.
+Things are binned by their center, a query grows by the widest thing in the grid.
+*/
+#define THING_GRID_DISTANCE_CELLS 64
+#define THING_GRID_LATERAL_CELLS  64
+#define THING_GRID_CELL_DISTANCE  1.0f
+#define THING_GRID_CELL_LATERAL   128.0f
+
+struct thing_grid
+{
+	int ThingCapacity;
+	
+	float MinLateral;
+	float MaxHalfWidth;
+	
+	int CellFirst[THING_GRID_DISTANCE_CELLS*THING_GRID_LATERAL_CELLS];
+	
+	//NOTE(moritz): All by thing ID. CellOfThing is -1 when the thing is not in the grid.
+	int *CellOfThing;
+	int *NextInCell;
+	int *PrevInCell;
+};
+
+void
+InitThingGrid(thing_grid *Grid, int ThingCapacity)
+{
+	Grid->ThingCapacity = ThingCapacity;
+	Grid->MinLateral    = -0.5f*THING_GRID_LATERAL_CELLS*THING_GRID_CELL_LATERAL;
+	Grid->MaxHalfWidth  = 0.0f;
+	
+	for(int CellIndex = 0;
+		CellIndex < (int)ArrayCount(Grid->CellFirst);
+		++CellIndex)
+	{
+		Grid->CellFirst[CellIndex] = -1;
+	}
+	
+	Grid->CellOfThing = (int *)malloc(sizeof(int)*ThingCapacity);
+	Grid->NextInCell  = (int *)malloc(sizeof(int)*ThingCapacity);
+	Grid->PrevInCell  = (int *)malloc(sizeof(int)*ThingCapacity);
+	
+	for(int ID = 0;
+		ID < ThingCapacity;
+		++ID)
+	{
+		Grid->CellOfThing[ID] = -1;
+		Grid->NextInCell[ID]  = -1;
+		Grid->PrevInCell[ID]  = -1;
+	}
+}
+
+//NOTE(moritz): Lateral offset from the road center at depth scale 1. Same terms DetermineThingFrameProperties places the sprite with.
+inline float
+ThingLateralOffset(thing *Thing, float BaseRoadHalfWidth)
+{
+	Texture2D CurrentTexture = Thing->Billboard->TextureRight;
+	if(Thing->RoadSide == -1.0f)
+		CurrentTexture = Thing->Billboard->TextureLeft;
+	
+	float Result = Thing->RoadSide*(BaseRoadHalfWidth + 0.5f*(float)CurrentTexture.width) + Thing->XOffset;
+	return(Result);
+}
+
+inline float
+ThingHalfWidth(thing *Thing)
+{
+	float Result = 0.5f*(float)Thing->Billboard->TextureRight.width*Thing->Billboard->SpriteScale;
+	return(Result);
+}
+
+inline int
+ThingGridDistanceCell(float Distance)
+{
+	int Result = (int)floorf(Distance*(1.0f/THING_GRID_CELL_DISTANCE));
+	return(Result);
+}
+
+inline int
+ThingGridLateralCell(thing_grid *Grid, float Lateral)
+{
+	int Result = (int)floorf((Lateral - Grid->MinLateral)*(1.0f/THING_GRID_CELL_LATERAL));
+	if(Result < 0)
+		Result = 0;
+	if(Result > (THING_GRID_LATERAL_CELLS - 1))
+		Result = THING_GRID_LATERAL_CELLS - 1;
+	
+	return(Result);
+}
+
+void
+UnlinkFromThingGrid(thing_grid *Grid, int ID)
+{
+	int Cell = Grid->CellOfThing[ID];
+	if(Cell < 0)
+		return;
+	
+	int Prev = Grid->PrevInCell[ID];
+	int Next = Grid->NextInCell[ID];
+	
+	if(Prev >= 0)
+		Grid->NextInCell[Prev] = Next;
+	else
+		Grid->CellFirst[Cell] = Next;
+	
+	if(Next >= 0)
+		Grid->PrevInCell[Next] = Prev;
+	
+	Grid->CellOfThing[ID] = -1;
+	Grid->NextInCell[ID]  = -1;
+	Grid->PrevInCell[ID]  = -1;
+}
+
+void
+LinkIntoThingGrid(thing_grid *Grid, int ID, int Cell)
+{
+	int First = Grid->CellFirst[Cell];
+	
+	Grid->NextInCell[ID] = First;
+	Grid->PrevInCell[ID] = -1;
+	if(First >= 0)
+		Grid->PrevInCell[First] = ID;
+	
+	Grid->CellFirst[Cell]  = ID;
+	Grid->CellOfThing[ID]  = Cell;
+}
+
+//NOTE(moritz): Things beyond the grid's distance range just drop out.
+void
+UpdateThingGrid(thing_grid *Grid, thing_store *Store, float BaseRoadHalfWidth)
+{
+	for(int ID = 0;
+		ID < Store->Count;
+		++ID)
+	{
+		thing *Thing = GetThing(Store, ID);
+		
+		int Cell = -1;
+		if(!Thing->IsDeleted && !Thing->IsAlien)
+		{
+			//NOTE(moritz): Things that passed the camera this tick stay in the nearest cell until they get recycled
+			int DistanceCell = ThingGridDistanceCell(Thing->Distance);
+			if(DistanceCell < 0)
+				DistanceCell = 0;
+			if(DistanceCell < THING_GRID_DISTANCE_CELLS)
+			{
+				int LateralCell = ThingGridLateralCell(Grid, ThingLateralOffset(Thing, BaseRoadHalfWidth));
+				Cell = DistanceCell*THING_GRID_LATERAL_CELLS + LateralCell;
+			}
+		}
+		
+		if(Cell != Grid->CellOfThing[ID])
+		{
+			UnlinkFromThingGrid(Grid, ID);
+			if(Cell >= 0)
+			{
+				LinkIntoThingGrid(Grid, ID, Cell);
+				Grid->MaxHalfWidth = Max(Grid->MaxHalfWidth, ThingHalfWidth(Thing));
+			}
+		}
+	}
+}
+
+//NOTE(moritz): Writes the IDs of all things binned around the given area, up to MaxIDCount.
+//Returns the number of IDs found, which is more than were written when IDsOut was too small.
+int
+QueryThingGrid(thing_grid *Grid, float MinDistance, float MaxDistance, float MinLateral, float MaxLateral,
+			   int *IDsOut, int MaxIDCount)
+{
+	int DistanceCell0 = ThingGridDistanceCell(MinDistance);
+	int DistanceCell1 = ThingGridDistanceCell(MaxDistance);
+	if(DistanceCell0 < 0)
+		DistanceCell0 = 0;
+	if(DistanceCell1 > (THING_GRID_DISTANCE_CELLS - 1))
+		DistanceCell1 = THING_GRID_DISTANCE_CELLS - 1;
+	
+	int LateralCell0 = ThingGridLateralCell(Grid, MinLateral - Grid->MaxHalfWidth);
+	int LateralCell1 = ThingGridLateralCell(Grid, MaxLateral + Grid->MaxHalfWidth);
+	
+	int IDCount = 0;
+	for(int DistanceCell = DistanceCell0;
+		DistanceCell <= DistanceCell1;
+		++DistanceCell)
+	{
+		for(int LateralCell = LateralCell0;
+			LateralCell <= LateralCell1;
+			++LateralCell)
+		{
+			for(int ID = Grid->CellFirst[DistanceCell*THING_GRID_LATERAL_CELLS + LateralCell];
+				ID >= 0;
+				ID = Grid->NextInCell[ID])
+			{
+				if(IDCount < MaxIDCount)
+					IDsOut[IDCount] = ID;
+				++IDCount;
+			}
+		}
+	}
+	
+	return(IDCount);
+}
+
+/* NOTE(moritz):
+Engine sound. engine0..engine7 are the same engine recorded at rising rpm, every one a bit higher
+pitched (and so shorter) than the one before. All eight get decoded into one bank at startup and
+an AudioStream callback mixes them on the audio thread:
+
+rpm 0..1 picks a pair of neighbouring layers. The lower one gets pitched up and the upper one down
+so both sound like the same rpm (the pitch step between two layers falls out of their lengths),
+then they get crossfaded (equal power). At the ends of the pair each layer plays at its own pitch,
+so stepping on to the next pair is seamless.
+
+The game thread only ever stores TargetRpm/TargetVolume (atomics, no lock), the callback smooths
+towards them per sample so changes don't zipper.
+*/
+
+#define ENGINE_LAYER_COUNT 8
+#define ENGINE_SAMPLE_RATE 44100
+#define ENGINE_SMOOTHING 0.0005f //NOTE(moritz): Per sample, ~50ms to catch up
+
+struct engine_layer
+{
+	short *Samples; //NOTE(moritz): Interleaved stereo, points into the bank
+	unsigned int FrameCount;
+	double Position;
+};
+
+struct engine_mixer
+{
+	short *Bank;
+	engine_layer Layers[ENGINE_LAYER_COUNT];
+	float PitchToNext[ENGINE_LAYER_COUNT];
+	
+	bool IsLoaded;
+	bool IsPlaying;
+	AudioStream Stream;
+	
+	//NOTE(moritz): Written by the game thread
+	std::atomic<float> TargetRpm;
+	std::atomic<float> TargetVolume;
+	
+	//NOTE(moritz): Audio callback only
+	float Rpm;
+	float Volume;
+};
+
+global engine_mixer EngineMixer;
+
+//NOTE(moritz): CPU side only, fine before the audio device is open
+void
+LoadEngineBank(engine_mixer *Mixer)
+{
+	Wave LayerWaves[ENGINE_LAYER_COUNT] = {};
+	unsigned int BankFrameCount = 0;
+	for(int LayerIndex = 0;
+		LayerIndex < ENGINE_LAYER_COUNT;
+		++LayerIndex)
+	{
+		Wave *LayerWave = LayerWaves + LayerIndex;
+		*LayerWave = LoadWaveAsset(TextFormat("engine%d.wav", LayerIndex));
+		if(!LayerWave->data || !LayerWave->frameCount)
+		{
+			TraceLog(LOG_WARNING, "Engine layer %d missing, no engine sound", LayerIndex);
+			for(int UnloadIndex = 0;
+				UnloadIndex <= LayerIndex;
+				++UnloadIndex)
+			{
+				UnloadWave(LayerWaves[UnloadIndex]);
+			}
+			return;
+		}
+		
+		WaveFormat(LayerWave, ENGINE_SAMPLE_RATE, 16, 2);
+		BankFrameCount += LayerWave->frameCount;
+	}
+	
+	Mixer->Bank = (short *)malloc(sizeof(short)*2*BankFrameCount);
+	
+	short *BankAt = Mixer->Bank;
+	for(int LayerIndex = 0;
+		LayerIndex < ENGINE_LAYER_COUNT;
+		++LayerIndex)
+	{
+		engine_layer *Layer = Mixer->Layers + LayerIndex;
+		Layer->Samples    = BankAt;
+		Layer->FrameCount = LayerWaves[LayerIndex].frameCount;
+		Layer->Position   = 0.0;
+		
+		memcpy(BankAt, LayerWaves[LayerIndex].data, sizeof(short)*2*Layer->FrameCount);
+		BankAt += 2*Layer->FrameCount;
+		
+		UnloadWave(LayerWaves[LayerIndex]);
+	}
+	
+	for(int LayerIndex = 0;
+		LayerIndex < (ENGINE_LAYER_COUNT - 1);
+		++LayerIndex)
+	{
+		Mixer->PitchToNext[LayerIndex] = (float)Mixer->Layers[LayerIndex].FrameCount/(float)Mixer->Layers[LayerIndex + 1].FrameCount;
+	}
+	Mixer->PitchToNext[ENGINE_LAYER_COUNT - 1] = 1.0f;
+	
+	Mixer->TargetRpm    = 0.0f;
+	Mixer->TargetVolume = 0.5f;
+	Mixer->Rpm    = 0.0f;
+	Mixer->Volume = 0.5f;
+	Mixer->IsLoaded = true;
+}
+
+inline float
+SampleEngineLayer(engine_layer *Layer, int Channel)
+{
+	unsigned int Frame0 = (unsigned int)Layer->Position;
+	unsigned int Frame1 = Frame0 + 1;
+	if(Frame1 >= Layer->FrameCount)
+		Frame1 = 0;
+	
+	float t = (float)(Layer->Position - (double)Frame0);
+	float Sample0 = (float)Layer->Samples[2*Frame0 + Channel];
+	float Sample1 = (float)Layer->Samples[2*Frame1 + Channel];
+	
+	return(LerpM(Sample0, t, Sample1)*(1.0f/32768.0f));
+}
+
+inline void
+AdvanceEngineLayer(engine_layer *Layer, float Rate)
+{
+	Layer->Position += (double)Rate;
+	while(Layer->Position >= (double)Layer->FrameCount)
+		Layer->Position -= (double)Layer->FrameCount;
+}
+
+//NOTE(moritz): Runs on the audio thread (native) or from the browser's audio callback (web)
+void
+EngineMixerCallback(void *BufferData, unsigned int FrameCount)
+{
+	engine_mixer *Mixer = &EngineMixer;
+	float *Out = (float *)BufferData;
+	
+	float TargetRpm    = Mixer->TargetRpm.load(std::memory_order_relaxed);
+	float TargetVolume = Mixer->TargetVolume.load(std::memory_order_relaxed);
+	
+	float Rpm    = Mixer->Rpm;
+	float Volume = Mixer->Volume;
+	for(unsigned int FrameIndex = 0;
+		FrameIndex < FrameCount;
+		++FrameIndex)
+	{
+		Rpm    += ENGINE_SMOOTHING*(TargetRpm - Rpm);
+		Volume += ENGINE_SMOOTHING*(TargetVolume - Volume);
+		
+		float LayerP = Rpm*(float)(ENGINE_LAYER_COUNT - 1);
+		int LowerIndex = (int)LayerP;
+		if(LowerIndex > (ENGINE_LAYER_COUNT - 2))
+			LowerIndex = ENGINE_LAYER_COUNT - 2;
+		if(LowerIndex < 0)
+			LowerIndex = 0;
+		float t = ClampM(0.0f, LayerP - (float)LowerIndex, 1.0f);
+		
+		engine_layer *Lower = Mixer->Layers + LowerIndex;
+		engine_layer *Upper = Lower + 1;
+		
+		float PitchToNext = Mixer->PitchToNext[LowerIndex];
+		float LowerRate = powf(PitchToNext, t);
+		float UpperRate = LowerRate/PitchToNext;
+		
+		float LowerGain = Volume*cosf(0.5f*Pi32*t);
+		float UpperGain = Volume*sinf(0.5f*Pi32*t);
+		
+		Out[2*FrameIndex + 0] = (LowerGain*SampleEngineLayer(Lower, 0) +
+								 UpperGain*SampleEngineLayer(Upper, 0));
+		Out[2*FrameIndex + 1] = (LowerGain*SampleEngineLayer(Lower, 1) +
+								 UpperGain*SampleEngineLayer(Upper, 1));
+		
+		AdvanceEngineLayer(Lower, LowerRate);
+		AdvanceEngineLayer(Upper, UpperRate);
+	}
+	
+	Mixer->Rpm    = Rpm;
+	Mixer->Volume = Volume;
+}
+
+//NOTE(moritz): Needs the audio device
+void
+StartEngineMixer(engine_mixer *Mixer)
+{
+	if(!Mixer->IsLoaded || Mixer->IsPlaying)
+		return;
+	
+	Mixer->Stream = LoadAudioStream(ENGINE_SAMPLE_RATE, 32, 2);
+	SetAudioStreamCallback(Mixer->Stream, EngineMixerCallback);
+	PlayAudioStream(Mixer->Stream);
+	Mixer->IsPlaying = true;
+}
+
+//NOTE(moritz): Game thread, never blocks
+inline void
+SetEngineRpm(engine_mixer *Mixer, float Rpm)
+{
+	Mixer->TargetRpm.store(ClampM(0.0f, Rpm, 1.0f), std::memory_order_relaxed);
+}
+
+/* NOTE(moritz):
+Sound effects don't go through raylib's PlaySound anymore, every one of those calls takes the
+audio lock against the mixer thread. The game pushes commands into a single producer/single
+consumer ring instead, the sfx stream's callback drains it at the start of every buffer and
+mixes the voices itself. Neither side ever waits on the other, if the ring is full the command
+is dropped (and counted).
+
+Each command carries the time it was issued, the callback measures from there until it got
+mixed plus the length of the buffer it lands in, that's about when it becomes audible.
+*/
+
+#define AUDIO_COMMAND_RING_SIZE 256 //NOTE(moritz): Power of two
+
+enum audio_command_type
+{
+	AudioCommand_Play,
+	AudioCommand_StopAll,
+};
+
+struct audio_command
+{
+	audio_command_type Type;
+	int SfxID;
+	float Volume;
+	float Pitch;
+	double IssueTime;
+};
+
+struct audio_command_ring
+{
+	audio_command Commands[AUDIO_COMMAND_RING_SIZE];
 	
-	//NOTE(moritz):Clamp to screen coords to avoid some invalid memory access bug
-	BasePScreenY = ClampM(0.0f, BasePScreenY, fScreenHeight);
+	//NOTE(moritz): Only ever count up, the slot is Index & (AUDIO_COMMAND_RING_SIZE - 1)
+	std::atomic<unsigned int> WriteIndex; //NOTE(moritz): Game thread
+	std::atomic<unsigned int> ReadIndex;  //NOTE(moritz): Audio callback
+};
+
+//NOTE(moritz): Game thread only
+bool
+PushAudioCommand(audio_command_ring *Ring, audio_command *Command)
+{
+	unsigned int WriteIndex = Ring->WriteIndex.load(std::memory_order_relaxed);
+	unsigned int ReadIndex  = Ring->ReadIndex.load(std::memory_order_acquire);
+	if((WriteIndex - ReadIndex) >= AUDIO_COMMAND_RING_SIZE)
+		return(false);
 	
-	//NOTE(moritz): Where the sprite will be at the bottom of the Road
-	//float BasePOffsetX = BaseRoadHalfWidth + 300.0f + 0.5f*((float)Texture.width);
+	Ring->Commands[WriteIndex & (AUDIO_COMMAND_RING_SIZE - 1)] = *Command;
+	Ring->WriteIndex.store(WriteIndex + 1, std::memory_order_release);
 	
-	//NOTE(moritz): In case of vehicle either left or right is fine
-	Texture2D CurrentTexture = Billboard->TextureRight;
+	return(true);
+}
+
+//NOTE(moritz): Audio callback only
+bool
+PopAudioCommand(audio_command_ring *Ring, audio_command *Command)
+{
+	unsigned int ReadIndex  = Ring->ReadIndex.load(std::memory_order_relaxed);
+	unsigned int WriteIndex = Ring->WriteIndex.load(std::memory_order_acquire);
+	if(ReadIndex == WriteIndex)
+		return(false);
 	
-	if(Thing->RoadSide == -1.0f)
-		CurrentTexture = Billboard->TextureLeft;
-	else if(Thing->RoadSide == 1.0f)
-		CurrentTexture = Billboard->TextureRight;
+	*Command = Ring->Commands[ReadIndex & (AUDIO_COMMAND_RING_SIZE - 1)];
+	Ring->ReadIndex.store(ReadIndex + 1, std::memory_order_release);
 	
-	float BasePOffsetX = Thing->RoadSide*0.5f*((float)CurrentTexture.width) + Thing->XOffset;
-	float SpriteScale  = Billboard->SpriteScale;
-	float SpriteVerticalTweak = Billboard->SpriteVerticalTweak;
+	return(true);
+}
+
+#define SFX_SAMPLE_RATE 44100
+
+enum sfx_id
+{
+	Sfx_Lazer,
+	Sfx_CrosshairBlip,
 	
-	//NOTE(moritz): Some more lerping for the X part of BaseP. Taking into account curviness, angle of road and all that nonesense...
-	//float fDepthLineCount = (float)DepthLineCount;
+	Sfx_Count,
+};
+
+/* NOTE(moritz):
+Sfx play on a fixed pool of voices that all read the same sample, so layering a sound costs a
+voice and no memory. When a sound has used up its MaxVoices, its oldest voice gets restarted.
+When the pool is full, the oldest voice of the lowest priority that isn't higher than the new
+sound's gets stolen, otherwise the new sound is dropped.
+On top, PlaySfx only lets MaxPlaysPerFrame of a sound through each game frame, ten lazers in the
+same frame just sound like a louder one anyway.
+*/
+
+#define SFX_VOICE_COUNT 16
+
+struct sfx_info
+{
+	//NOTE(moritz): Without the file extension, there's a .sfa (see encode_sfx.py) and the .wav it came from
+	const char *FileName;
+	int Priority; //NOTE(moritz): Higher wins
+	int MaxVoices;
+	int MaxPlaysPerFrame;
+};
+
+global sfx_info SfxInfos[Sfx_Count] =
+{
+	{"lazer",          2, 6, 2},
+	{"crosshair_blip", 1, 2, 1},
+};
+
+//NOTE(moritz): Stereo 44.1k compact sounds get mixed straight from the compressed groups
+#define SFX_CACHE_FRAMES (COMPACT_SOUND_GROUP_SAMPLES/2)
+
+struct sfx_sample
+{
+	compact_sound Compact;
+	short *Samples; //NOTE(moritz): Interleaved stereo, only without a usable compact sound
+	unsigned int FrameCount;
+};
+
+struct sfx_voice
+{
+	bool IsPlaying;
+	int SfxID;
+	unsigned int StartIndex; //NOTE(moritz): Order the voices were started in, for stealing the oldest
 	
-	//TODO(moritz): Figure out which road segment we are in
-	//Used closed formula to determine 
+	double Position;
+	float Rate;
+	float Volume;
 	
-	float fBasePDepthLineIndex = (float)BasePDepthLineIndex;
+	//NOTE(moritz): The decoded group of a compact sound the voice is in
+	unsigned int CachedGroup;
+	short Cache[2*SFX_CACHE_FRAMES];
+};
+
+struct sfx_mixer
+{
+	sfx_sample Samples[Sfx_Count];
 	
-	road_segment *CurrentSegment = ActiveRoadList->First;
+	//NOTE(moritz): Audio callback only
+	sfx_voice Voices[SFX_VOICE_COUNT];
+	unsigned int NextStartIndex;
 	
-	float dX = 0.0f;
-	float fCurrentCenterOffsetX = 0.0f;
+	audio_command_ring Commands;
 	
-	float X0 = 0.0f;
-	float X1 = 0.0f;
+	//NOTE(moritz): Game thread
+	int DroppedCommandCount;
+	int FramePlayCounts[Sfx_Count];
+	int CappedPlayCount;
 	
-	int OnePastLastDepthLine = BasePDepthLineIndex + 1;
+	bool IsPlaying;
+	AudioStream Stream;
 	
-	for(int DepthLineIndex = 0;
-		DepthLineIndex < OnePastLastDepthLine;
-		++DepthLineIndex)
+	//NOTE(moritz): Written by the audio callback
+	std::atomic<float> LatencyLast;
+	std::atomic<float> LatencyMax;
+	std::atomic<int> ActiveVoiceCount;
+	std::atomic<int> StolenVoiceCount;
+	std::atomic<int> RejectedPlayCount;
+};
+
+global sfx_mixer SfxMixer;
+
+//NOTE(moritz): CPU side only, fine before the audio device is open
+void
+LoadSfxSamples(sfx_mixer *Mixer)
+{
+	for(int SfxID = 0;
+		SfxID < Sfx_Count;
+		++SfxID)
 	{
-		float fLineY = (float)DepthLineIndex;
-		float fYLineNorm = fLineY/fDepthLineCount;
+		sfx_sample *Sample = Mixer->Samples + SfxID;
 		
-		float fRoadWidth   = BaseRoadHalfWidth*DepthLines[DepthLineIndex].Scale/* + 20.0f*/;
-		float Blarg        = BasePOffsetX *DepthLines[DepthLineIndex].Scale;
-		
-		if(CurrentSegment->Next)
+		unsigned int CompactSize = 0;
+		unsigned char *CompactData = LoadFileAsset(TextFormat("%s.sfa", SfxInfos[SfxID].FileName), &CompactSize);
+		if(OpenCompactSound(&Sample->Compact, CompactData, CompactSize) &&
+		   (Sample->Compact.Channels == 2) && (Sample->Compact.SampleRate == SFX_SAMPLE_RATE))
 		{
-			if(fYLineNorm > CurrentSegment->Next->Position)
-				CurrentSegment = CurrentSegment->Next;
+			Sample->FrameCount = Sample->Compact.FrameCount;
+			TraceLog(LOG_INFO, "Sfx %s: %u KB compact, %u KB as pcm", SfxInfos[SfxID].FileName,
+					 CompactSize/1024, (unsigned int)(sizeof(short)*2*Sample->FrameCount)/1024);
+			continue;
 		}
+		Sample->Compact = {};
 		
-		dX += CurrentSegment->ddX;
-		fCurrentCenterOffsetX += dX;
+		Wave SfxWave = LoadWaveAsset(TextFormat("%s.wav", SfxInfos[SfxID].FileName));
+		if(SfxWave.data && SfxWave.frameCount)
+		{
+			WaveFormat(&SfxWave, SFX_SAMPLE_RATE, 16, 2);
+			
+			Sample->FrameCount = SfxWave.frameCount;
+			Sample->Samples = (short *)malloc(sizeof(short)*2*Sample->FrameCount);
+			memcpy(Sample->Samples, SfxWave.data, sizeof(short)*2*Sample->FrameCount);
+		}
 		
-		//NOTE(moritz): Made up damping... Seems better
-		float CurveDamping = sinf(fYLineNorm*0.5f*Pi32);
-		CurveDamping = ClampM(0.0f, CurveDamping, 1.0f);
-		fCurrentCenterOffsetX *= CurveDamping;
+		UnloadWave(SfxWave);
+	}
+}
+
+inline short *
+GetSfxFrame(sfx_sample *Sample, sfx_voice *Voice, unsigned int Frame)
+{
+	if(!Sample->Compact.Groups)
+		return(Sample->Samples + 2*Frame);
+	
+	unsigned int GroupIndex = Frame/SFX_CACHE_FRAMES;
+	if(GroupIndex != Voice->CachedGroup)
+	{
+		DecodeCompactSoundGroup(&Sample->Compact, GroupIndex, Voice->Cache);
+		Voice->CachedGroup = GroupIndex;
+	}
+	
+	return(Voice->Cache + 2*(Frame - GroupIndex*SFX_CACHE_FRAMES));
+}
+
+//NOTE(moritz): Audio callback only. The voice a new SfxID should play on, 0 if it doesn't get one
+sfx_voice *
+AllocateSfxVoice(sfx_mixer *Mixer, int SfxID)
+{
+	sfx_info *Info = SfxInfos + SfxID;
+	
+	int SameCount = 0;
+	sfx_voice *OldestSame = 0;
+	sfx_voice *Free = 0;
+	sfx_voice *Victim = 0;
+	for(int VoiceIndex = 0;
+		VoiceIndex < SFX_VOICE_COUNT;
+		++VoiceIndex)
+	{
+		sfx_voice *Voice = Mixer->Voices + VoiceIndex;
+		if(!Voice->IsPlaying)
+		{
+			if(!Free)
+				Free = Voice;
+			continue;
+		}
 		
-		float SteerOffset = AngleOfRoad*(fDepthLineCount - fLineY);
+		if(Voice->SfxID == SfxID)
+		{
+			++SameCount;
+			if(!OldestSame || ((int)(Voice->StartIndex - OldestSame->StartIndex) < 0))
+				OldestSame = Voice;
+		}
 		
-		if(DepthLineIndex == (OnePastLastDepthLine - 2))
-			X0 = 0.5f*fScreenWidth + fCurrentCenterOffsetX + SteerOffset + Thing->RoadSide*fRoadWidth + Blarg;
-		else if(DepthLineIndex == (OnePastLastDepthLine - 1))
-			X1 = 0.5f*fScreenWidth + fCurrentCenterOffsetX + SteerOffset + Thing->RoadSide*fRoadWidth + Blarg;
+		int Priority = SfxInfos[Voice->SfxID].Priority;
+		if(Priority <= Info->Priority)
+		{
+			if(!Victim)
+			{
+				Victim = Voice;
+			}
+			else
+			{
+				int VictimPriority = SfxInfos[Victim->SfxID].Priority;
+				if((Priority < VictimPriority) ||
+				   ((Priority == VictimPriority) && ((int)(Voice->StartIndex - Victim->StartIndex) < 0)))
+					Victim = Voice;
+			}
+		}
 	}
 	
+	sfx_voice *Result = 0;
+	if(SameCount >= Info->MaxVoices)
+		Result = OldestSame;
+	else if(Free)
+		Result = Free;
+	else
+		Result = Victim;
 	
-	Vector2 BaseP = {};
-	BaseP.x = LerpM(X0, t, X1);
-	BaseP.y = BasePScreenY;
+	if(Result && Result->IsPlaying)
+		Mixer->StolenVoiceCount.fetch_add(1, std::memory_order_relaxed);
 	
+	return(Result);
+}
+
+void
+SfxMixerCallback(void *BufferData, unsigned int FrameCount)
+{
+	sfx_mixer *Mixer = &SfxMixer;
+	float *Out = (float *)BufferData;
 	
-	//NOTE(moritz): Convert from BaseP to draw p... complying with raylib convention
-	Vector2 SpriteDrawP = {};
-	SpriteDrawP.x = BaseP.x - 0.5f*((float)CurrentTexture.width)*DepthScale*SpriteScale*ScaleInT;
-	SpriteDrawP.y = BaseP.y - ((float)CurrentTexture.height)*DepthScale*SpriteScale*ScaleInT + SpriteVerticalTweak*(float)CurrentTexture.height*DepthScale*SpriteScale*ScaleInT;
+	double Now = GetTime();
+	float BufferSeconds = (float)FrameCount/(float)SFX_SAMPLE_RATE;
 	
-#if 0
-	DrawTextureEx(CurrentTexture, SpriteDrawP, 0.0f, DepthScale*SpriteScale*ScaleInT, Thing->Tint/*WHITE*/);
-#endif
+	audio_command Command;
+	while(PopAudioCommand(&Mixer->Commands, &Command))
+	{
+		switch(Command.Type)
+		{
+			case AudioCommand_Play:
+			{
+				if((Command.SfxID < 0) || (Command.SfxID >= Sfx_Count) || !Mixer->Samples[Command.SfxID].FrameCount)
+					break;
+				
+				sfx_voice *Voice = AllocateSfxVoice(Mixer, Command.SfxID);
+				if(!Voice)
+				{
+					Mixer->RejectedPlayCount.fetch_add(1, std::memory_order_relaxed);
+					break;
+				}
+				
+				Voice->IsPlaying   = true;
+				Voice->SfxID       = Command.SfxID;
+				Voice->StartIndex  = Mixer->NextStartIndex++;
+				Voice->CachedGroup = U32Max;
+				Voice->Position    = 0.0;
+				Voice->Rate        = Command.Pitch;
+				Voice->Volume      = Command.Volume;
+			} break;
+			
+			case AudioCommand_StopAll:
+			{
+				for(int VoiceIndex = 0;
+					VoiceIndex < SFX_VOICE_COUNT;
+					++VoiceIndex)
+				{
+					Mixer->Voices[VoiceIndex].IsPlaying = false;
+				}
+			} break;
+		}
+		
+		float Latency = (float)(Now - Command.IssueTime) + BufferSeconds;
+		Mixer->LatencyLast.store(Latency, std::memory_order_relaxed);
+		if(Latency > Mixer->LatencyMax.load(std::memory_order_relaxed))
+			Mixer->LatencyMax.store(Latency, std::memory_order_relaxed);
+	}
 	
-	Thing->FrameBaseP = BaseP;
-	Thing->FramePosition = SpriteDrawP;
-	Thing->FrameScale = DepthScale*SpriteScale*ScaleInT;
+	for(unsigned int SampleIndex = 0;
+		SampleIndex < 2*FrameCount;
+		++SampleIndex)
+	{
+		Out[SampleIndex] = 0.0f;
+	}
+	
+	int ActiveVoiceCount = 0;
+	for(int VoiceIndex = 0;
+		VoiceIndex < SFX_VOICE_COUNT;
+		++VoiceIndex)
+	{
+		sfx_voice *Voice = Mixer->Voices + VoiceIndex;
+		if(!Voice->IsPlaying)
+			continue;
+		
+		sfx_sample *Sample = Mixer->Samples + Voice->SfxID;
+		++ActiveVoiceCount;
+		
+		float Gain = Voice->Volume*(1.0f/32768.0f);
+		for(unsigned int FrameIndex = 0;
+			FrameIndex < FrameCount;
+			++FrameIndex)
+		{
+			unsigned int Frame = (unsigned int)Voice->Position;
+			if(Frame >= Sample->FrameCount)
+			{
+				Voice->IsPlaying = false;
+				break;
+			}
+			
+			short *Source = GetSfxFrame(Sample, Voice, Frame);
+			Out[2*FrameIndex + 0] += Gain*(float)Source[0];
+			Out[2*FrameIndex + 1] += Gain*(float)Source[1];
+			Voice->Position += (double)Voice->Rate;
+		}
+	}
 	
+	Mixer->ActiveVoiceCount.store(ActiveVoiceCount, std::memory_order_relaxed);
 }
 
+//NOTE(moritz): Needs the audio device
 void
-DrawBillboard(billboard *Billboard, thing *Thing)
+StartSfxMixer(sfx_mixer *Mixer)
 {
-	if(!Thing->DrawMe)
+	if(Mixer->IsPlaying)
 		return;
 	
-	if(Thing->IsDeleted)
+	Mixer->Stream = LoadAudioStream(SFX_SAMPLE_RATE, 32, 2);
+	SetAudioStreamCallback(Mixer->Stream, SfxMixerCallback);
+	PlayAudioStream(Mixer->Stream);
+	Mixer->IsPlaying = true;
+}
+
+//NOTE(moritz): Game thread, never blocks
+void
+PlaySfx(sfx_mixer *Mixer, sfx_id SfxID, float Volume = 1.0f, float Pitch = 1.0f)
+{
+	if(!Mixer->IsPlaying)
 		return;
 	
-	//NOTE(moritz): In case of vehicle either left or right is fine
-	Texture2D CurrentTexture = Billboard->TextureRight;
-	
-	if(Thing->RoadSide == -1.0f)
-		CurrentTexture = Billboard->TextureLeft;
-	else if(Thing->RoadSide == 1.0f)
-		CurrentTexture = Billboard->TextureRight;
+	if(Mixer->FramePlayCounts[SfxID] >= SfxInfos[SfxID].MaxPlaysPerFrame)
+	{
+		++Mixer->CappedPlayCount;
+		return;
+	}
+	++Mixer->FramePlayCounts[SfxID];
 	
-	DrawTextureEx(CurrentTexture, Thing->FramePosition, 0.0f, Thing->FrameScale, Thing->Tint);
+	audio_command Command = {};
+	Command.Type      = AudioCommand_Play;
+	Command.SfxID     = SfxID;
+	Command.Volume    = Volume;
+	Command.Pitch     = Pitch;
+	Command.IssueTime = GetTime();
 	
-#if 0
-	//NOTE(moritz): Vis for sprite hot spots
-	Vector2 TestSize = {5.0f, 5.0f};
-	DrawRectangleV(Thing->FrameBaseP, TestSize, RED);
-	DrawRectangleV(Thing->FramePosition, TestSize, BLACK);
+	if(!PushAudioCommand(&Mixer->Commands, &Command))
+		++Mixer->DroppedCommandCount;
+}
+
+//NOTE(moritz): Game thread, once at the start of every frame
+void
+BeginSfxFrame(sfx_mixer *Mixer)
+{
+	for(int SfxID = 0;
+		SfxID < Sfx_Count;
+		++SfxID)
+	{
+		Mixer->FramePlayCounts[SfxID] = 0;
+	}
+}
+
+/* NOTE(moritz):
+Music gets decoded on its own thread, not by UpdateMusicStream on the main thread anymore.
+The decoder (dr_mp3, the one raylib is built with) fills a ring of fixed size pcm blocks, the
+music stream's callback copies them out. If the callback finds the ring empty it plays silence
+and counts an underrun, it never waits.
+
+How many blocks the decoder keeps ahead is picked from what it measures: the slowest block
+decode so far (twice, in case the thread gets descheduled) plus a fixed safety margin.
+
+Web builds have no threads, there UpdateAudio pumps the decoder once per frame, which still
+gets the decode out of the audio callback and keeps a few blocks of slack for long frames.
+Without dr_mp3.h (e.g. a system raylib) this falls back to raylib's Music.
+*/
+
+#ifdef MUSIC_STREAM_DECODER
+
+#define MUSIC_BLOCK_FRAMES 4096
+#define MUSIC_MAX_BLOCKS 32 //NOTE(moritz): Power of two
+#define MUSIC_MIN_PREFETCH_BLOCKS 2
+#define MUSIC_SAFETY_SECONDS 0.25f
+
+struct music_block
+{
+	short Samples[2*MUSIC_BLOCK_FRAMES];
+	unsigned int FrameCount;
+};
+
+struct music_streamer
+{
+	drmp3 Decoder;
+	bool IsOpen;
+	bool IsPlaying;
+	unsigned int Channels;
+	unsigned int SampleRate;
+	AudioStream Stream;
+	
+	music_block Blocks[MUSIC_MAX_BLOCKS];
+	std::atomic<unsigned int> WriteIndex; //NOTE(moritz): Decoder
+	std::atomic<unsigned int> ReadIndex;  //NOTE(moritz): Audio callback
+	unsigned int ReadFrame; //NOTE(moritz): Audio callback, position in the current block
+	
+	//NOTE(moritz): Decoder only
+	float WorstBlockSeconds;
+	double DecodeSeconds;
+	double DecodedAudioSeconds;
+	
+	//NOTE(moritz): For the overlay
+	std::atomic<int> PrefetchBlocks;
+	std::atomic<int> UnderrunCount;
+	std::atomic<float> DecodeSpeed; //NOTE(moritz): Seconds of audio per second of decoding
+	
+#ifdef ASSET_LOADER_THREADS
+	std::thread Thread;
+	std::atomic<bool> Quit;
 #endif
+};
+
+global music_streamer MusicStreamer;
+
+//NOTE(moritz): Decodes the next block if the ring isn't as full as it should be
+bool
+DecodeMusicBlock(music_streamer *Streamer)
+{
+	unsigned int WriteIndex = Streamer->WriteIndex.load(std::memory_order_relaxed);
+	unsigned int ReadIndex  = Streamer->ReadIndex.load(std::memory_order_acquire);
+	if((int)(WriteIndex - ReadIndex) >= Streamer->PrefetchBlocks.load(std::memory_order_relaxed))
+		return(false);
 	
-#if 0
-	//NOTE(moritz): Collision line vis
-	float ColHalfLength = 0.5f*(float)CurrentTexture.width*Thing->FrameScale;
-	Vector2 ColLineStart;
-	ColLineStart.x = Thing->FrameBaseP.x - ColHalfLength;
-	ColLineStart.y = Thing->FrameBaseP.y;
-	Vector2 ColLineEnd;
-	ColLineEnd.x = Thing->FrameBaseP.x + ColHalfLength;
-	ColLineEnd.y = Thing->FrameBaseP.y;
-	DrawLineEx(ColLineStart, ColLineEnd, 2.0f, BROWN);
+	double StartTime = GetTime();
+	
+	music_block *Block = Streamer->Blocks + (WriteIndex & (MUSIC_MAX_BLOCKS - 1));
+	unsigned int FrameCount = (unsigned int)drmp3_read_pcm_frames_s16(&Streamer->Decoder, MUSIC_BLOCK_FRAMES, Block->Samples);
+	if(FrameCount < MUSIC_BLOCK_FRAMES)
+	{
+		//NOTE(moritz): Loop
+		drmp3_seek_to_pcm_frame(&Streamer->Decoder, 0);
+		FrameCount += (unsigned int)drmp3_read_pcm_frames_s16(&Streamer->Decoder, MUSIC_BLOCK_FRAMES - FrameCount,
+															  Block->Samples + Streamer->Channels*FrameCount);
+	}
+	Block->FrameCount = FrameCount;
+	
+	Streamer->WriteIndex.store(WriteIndex + 1, std::memory_order_release);
+	
+	float BlockSeconds = (float)(GetTime() - StartTime);
+	if(BlockSeconds > Streamer->WorstBlockSeconds)
+		Streamer->WorstBlockSeconds = BlockSeconds;
+	Streamer->DecodeSeconds       += BlockSeconds;
+	Streamer->DecodedAudioSeconds += (double)FrameCount/(double)Streamer->SampleRate;
+	if(Streamer->DecodeSeconds > 0.0)
+		Streamer->DecodeSpeed.store((float)(Streamer->DecodedAudioSeconds/Streamer->DecodeSeconds), std::memory_order_relaxed);
+	
+	float BlockAudioSeconds = (float)MUSIC_BLOCK_FRAMES/(float)Streamer->SampleRate;
+	int PrefetchBlocks = (int)ceilf((MUSIC_SAFETY_SECONDS + 2.0f*Streamer->WorstBlockSeconds)/BlockAudioSeconds);
+	if(PrefetchBlocks < MUSIC_MIN_PREFETCH_BLOCKS)
+		PrefetchBlocks = MUSIC_MIN_PREFETCH_BLOCKS;
+	if(PrefetchBlocks > MUSIC_MAX_BLOCKS)
+		PrefetchBlocks = MUSIC_MAX_BLOCKS;
+	Streamer->PrefetchBlocks.store(PrefetchBlocks, std::memory_order_relaxed);
+	
+	return(true);
+}
+
+#ifdef ASSET_LOADER_THREADS
+void
+MusicDecoderThread(music_streamer *Streamer)
+{
+	float BlockAudioSeconds = (float)MUSIC_BLOCK_FRAMES/(float)Streamer->SampleRate;
+	while(!Streamer->Quit.load(std::memory_order_relaxed))
+	{
+		if(!DecodeMusicBlock(Streamer))
+			std::this_thread::sleep_for(std::chrono::duration<float>(0.25f*BlockAudioSeconds));
+	}
+}
 #endif
+
+void
+MusicStreamCallback(void *BufferData, unsigned int FrameCount)
+{
+	music_streamer *Streamer = &MusicStreamer;
+	short *Out = (short *)BufferData;
+	unsigned int Channels = Streamer->Channels;
+	
+	unsigned int FramesDone = 0;
+	while(FramesDone < FrameCount)
+	{
+		unsigned int ReadIndex  = Streamer->ReadIndex.load(std::memory_order_relaxed);
+		unsigned int WriteIndex = Streamer->WriteIndex.load(std::memory_order_acquire);
+		if(ReadIndex == WriteIndex)
+		{
+			memset(Out + Channels*FramesDone, 0, sizeof(short)*Channels*(FrameCount - FramesDone));
+			Streamer->UnderrunCount.fetch_add(1, std::memory_order_relaxed);
+			break;
+		}
+		
+		music_block *Block = Streamer->Blocks + (ReadIndex & (MUSIC_MAX_BLOCKS - 1));
+		unsigned int CopyCount = Block->FrameCount - Streamer->ReadFrame;
+		if(CopyCount > (FrameCount - FramesDone))
+			CopyCount = FrameCount - FramesDone;
+		
+		memcpy(Out + Channels*FramesDone, Block->Samples + Channels*Streamer->ReadFrame, sizeof(short)*Channels*CopyCount);
+		FramesDone          += CopyCount;
+		Streamer->ReadFrame += CopyCount;
+		
+		if(Streamer->ReadFrame >= Block->FrameCount)
+		{
+			Streamer->ReadFrame = 0;
+			Streamer->ReadIndex.store(ReadIndex + 1, std::memory_order_release);
+		}
+	}
 }
 
-inline void
-InitSegment(road_segment *Segment, road_segment *PrevSegment, random_series *Entropy, float MaxDistance)
+//NOTE(moritz): Cheap, unlike LoadMusicStream this doesn't walk the whole file first
+bool
+OpenMusicStreamer(music_streamer *Streamer, unsigned char *Bytes, unsigned int ByteCount)
 {
-	if(PrevSegment)
-		Segment->Position = PrevSegment->Position + 1.0f;//.2f + 0.5f*RandomUnilateral(Entropy); //NOTE(moritz): Float depth map position
+	if(!drmp3_init_memory(&Streamer->Decoder, Bytes, ByteCount, 0))
+		return(false);
 	
-	//float Rand = RandomBilateral(Entropy)*0.005f;
-	//float SignRand = Sign(Rand);
-	//Segment->ddX      = 0.005f*SignRand + Rand;
+	Streamer->IsOpen     = true;
+	Streamer->Channels   = Streamer->Decoder.channels;
+	Streamer->SampleRate = Streamer->Decoder.sampleRate;
+	if((Streamer->Channels < 1) || (Streamer->Channels > 2) || !Streamer->SampleRate)
+	{
+		drmp3_uninit(&Streamer->Decoder);
+		Streamer->IsOpen = false;
+		return(false);
+	}
 	
-	//Segment->Length   = 25.0f + 80.0f*RandomUnilateral(Entropy);
-	//Segment->EndRelPX = 250.0f*RandomBilateral(Entropy);
+	Streamer->PrefetchBlocks = MUSIC_MIN_PREFETCH_BLOCKS;
 	
-	//Segment->ddX      = 2.0f*(Segment->EndRelPX)/(MaxDistance*(MaxDistance + 1.0f));
+#ifdef ASSET_LOADER_THREADS
+	Streamer->Quit = false;
+	Streamer->Thread = std::thread(MusicDecoderThread, Streamer);
+#endif
 	
-	Segment->ddX = RoadPresets[XORShift32(Entropy) % ArrayCount(RoadPresets)];
+	return(true);
 }
 
-
-bool isImageClicked(const Vector2 & image_position, const float & image_scale, const Image & query_image) {
-	
-	float OneOverImageScale = 0.0f;
-	if(image_scale != 0.0f)
-		OneOverImageScale = 1.0f/image_scale;
-	
-	Vector2 Shrink = {5.0f, 5.0f};
-	Vector2 in_image_pos = (GetMousePosition() - image_position)*OneOverImageScale;
-	
+//NOTE(moritz): Main thread, once per frame. Starts playing as soon as enough is decoded
+void
+UpdateMusicStreamer(music_streamer *Streamer)
+{
+	if(!Streamer->IsOpen)
+		return;
 	
+#ifndef ASSET_LOADER_THREADS
+	DecodeMusicBlock(Streamer);
+#endif
 	
-	if( (in_image_pos.x + Shrink.x) >= 0 && (in_image_pos.x - Shrink.x) < query_image.width
-	   && (in_image_pos.y + Shrink.y) >= 0 && (in_image_pos.y - Shrink.y) < query_image.height) {
-		// look into image data
-		Color color = GetImageColor(query_image, in_image_pos.x, in_image_pos.y);
-		
-		return true;
-#if 0
-		if(color.a > 128) {
-			return true;
+	if(!Streamer->IsPlaying)
+	{
+		unsigned int Buffered = Streamer->WriteIndex.load(std::memory_order_acquire) - Streamer->ReadIndex.load(std::memory_order_relaxed);
+		if(Buffered >= MUSIC_MIN_PREFETCH_BLOCKS)
+		{
+			Streamer->Stream = LoadAudioStream(Streamer->SampleRate, 16, Streamer->Channels);
+			SetAudioStreamCallback(Streamer->Stream, MusicStreamCallback);
+			PlayAudioStream(Streamer->Stream);
+			Streamer->IsPlaying = true;
 		}
-#endif
 	}
-	return false;
 }
 
-struct _Skyline {
-	Texture2D loadAndSetWrap(const char *fileName) {
-		Texture2D texture = LoadTexture(fileName);
-		// SetTextureWrap(texture, TEXTURE_WRAP_REPEAT);
-		
-		return texture;
-	}
+void
+CloseMusicStreamer(music_streamer *Streamer)
+{
+	if(!Streamer->IsOpen)
+		return;
 	
-	const float panning[5] = {1.f/10, 1.f/8, 1.f/6, 1.f/4, 1.f/2};
-	const float pan_min = 1;
-	const float pan_max = 100;
+#ifdef ASSET_LOADER_THREADS
+	Streamer->Quit = true;
+	Streamer->Thread.join();
+#endif
+	
+	if(Streamer->IsPlaying)
+		UnloadAudioStream(Streamer->Stream);
+	drmp3_uninit(&Streamer->Decoder);
+	Streamer->IsOpen = false;
+}
+
+#endif
+
+/* NOTE(moritz):
+Browsers only allow opening the audio device after user input, that's why audio starts on the
+first click. Everything heavy happens before that: the sfx are decoded with the startup assets and
+the music bytes are already in memory (asset pack or prefetched file). The click only opens the
+device and starts the mixers, the music decoder starts filling its ring right away.
+
+On the raylib Music fallback LoadMusicStreamFromMemory walks the whole mp3 to count its frames,
+so on native builds that runs on a thread and the music comes in a few frames later. Web builds
+have no threads, there it's pushed to the frame after the click.
+*/
+
+struct audio_startup
+{
+	bool DeviceIsOpen;
+	bool MusicIsPlaying;
 	
-	Texture2D SkylineTextures[5] = {
-		loadAndSetWrap("city0.png"),
-		loadAndSetWrap("city1.png"),
-		loadAndSetWrap("city2.png"),
-		loadAndSetWrap("city3.png"),
-		loadAndSetWrap("city4.png") };
+	unsigned char *MusicBytes;
+	unsigned int MusicByteCount;
 	
-	const float screenW, screenH;
-	_Skyline(const float screenW, const float screenH) : screenW(screenW), screenH(screenH) { };
+	double ClickTime;
+	bool IsClickFrame;
 	
-	float getPanFactor(float z_min, float z_max, float t) {
-		return 1.f / LerpM(1.f/z_min, t, 1.f/z_max);
-	}
+#ifndef MUSIC_STREAM_DECODER
+	Music BackgroundMusic;
 	
-	void draw(float delta_time, float accumulated_velocity) {
-		for(int i = 0; i < 5; ++i) {
-			const Texture2D& cur_text = SkylineTextures[i];
-			const float pan_factor = getPanFactor(pan_min, pan_max , (float)i/5.);
-			float cur_panning = fmod(pan_factor * accumulated_velocity, cur_text.width);
-			
-			// repeat until multiples of screen
-			for(int pan_multipe = -1; pan_multipe*cur_text.width < screenW*2; ++pan_multipe) {
-				// const Rectangle source = {, 0, (float) cur_text.width*2, (float)cur_text.height*2};
-				// const Rectangle dest = { 0,0 , (float) screenW, (float) screenH};
-				// DrawTexturePro(cur_text, source, dest, {0,0}, 0, WHITE);
-				DrawTexture(cur_text, fmod(cur_panning,(float) screenW) + pan_multipe*cur_text.width, -50, WHITE);
-			}
-		}
-	}
+#ifdef ASSET_LOADER_THREADS
+	std::thread MusicLoader;
+	std::atomic<bool> MusicIsLoaded;
+#else
+	bool MusicIsLoaded;
+#endif
+#endif
 };
 
-bool
-LineLineIntersect(Vector2 P1, Vector2 P2,
-				  Vector2 P3, Vector2 P4)
+#ifndef MUSIC_STREAM_DECODER
+void
+LoadMusicFromPrefetch(audio_startup *Audio)
 {
-	float Denom = (P4.y - P3.y)*(P2.x - P1.x) - (P4.x - P3.x)*(P2.y - P1.y);
-	
-	if(Denom == 0.0f)
-		return false;
-	
-	float OneOverDenom = 1.0f/Denom;
-	
-	float tA = ((P4.x - P3.x)*(P1.y - P3.y) - (P4.y - P3.y)*(P1.x - P3.x))*OneOverDenom;
-	
-	float tB = ( (P2.x - P1.x)*(P1.y - P3.y) - (P2.y - P1.y)*(P1.x - P3.x) )*OneOverDenom;
+	Audio->BackgroundMusic = LoadMusicStreamFromMemory(".mp3", Audio->MusicBytes, (int)Audio->MusicByteCount);
+	Audio->MusicIsLoaded = true;
+}
+#endif
+
+//NOTE(moritz): Call on the first click
+void
+OpenAudio(audio_startup *Audio)
+{
+	Audio->ClickTime = GetTime();
+	Audio->IsClickFrame = true;
 	
-	bool Result = 
-	(tA >= 0.0f) && 
-	(tA <= 1.0f) &&
-	(tB >= 0.0f) &&
-	(tB <= 1.0f);
+	InitAudioDevice();
+	Audio->DeviceIsOpen = true;
 	
-	return(Result);
+	if(Audio->MusicBytes)
+	{
+#ifdef MUSIC_STREAM_DECODER
+		if(!OpenMusicStreamer(&MusicStreamer, Audio->MusicBytes, Audio->MusicByteCount))
+			TraceLog(LOG_WARNING, "Couldn't open the music for streaming");
+#elif defined(ASSET_LOADER_THREADS)
+		Audio->MusicLoader = std::thread(LoadMusicFromPrefetch, Audio);
+#endif
+	}
 }
 
+//NOTE(moritz): Call every frame, starts the music once it is loaded and keeps it streaming
 void
-AddAlienBullet(thing *Things, int *NumberOfThings, int *FirstFreeThing, int FrameAlienIndex, billboard *BulletBillboard)
+UpdateAudio(audio_startup *Audio)
 {
-	thing *NewBullet = 0;
-	if((*FirstFreeThing) >= 0)
+	if(!Audio->DeviceIsOpen || !Audio->MusicBytes)
+		return;
+	
+#ifdef MUSIC_STREAM_DECODER
+	UpdateMusicStreamer(&MusicStreamer);
+	
+	if(!Audio->MusicIsPlaying && MusicStreamer.IsPlaying)
 	{
-		thing *FreeThing = 0;
-		for(int ThingIndex = 0;
-			ThingIndex < (*NumberOfThings);
-			++ThingIndex)
-		{
-			if(Things[ThingIndex].ID == (*FirstFreeThing))
-			{
-				FreeThing = Things + ThingIndex;
-			}
-		}
-		
-		NewBullet = FreeThing;
-		*FirstFreeThing = FreeThing->NextIDInFreeList;
-		
-		*NewBullet = {};
+		Audio->MusicIsPlaying = true;
+		TraceLog(LOG_INFO, "Music started %.1f ms after the click", 1000.0*(GetTime() - Audio->ClickTime));
 	}
-	else
+#else
+	if(!Audio->MusicIsPlaying)
 	{
-		NewBullet = Things + *NumberOfThings;
-		*NumberOfThings += 1;
+#ifndef ASSET_LOADER_THREADS
+		//NOTE(moritz): Not on the click frame itself
+		if(!Audio->MusicIsLoaded && !Audio->IsClickFrame)
+			LoadMusicFromPrefetch(Audio);
+#endif
+		
+		if(Audio->MusicIsLoaded)
+		{
+#ifdef ASSET_LOADER_THREADS
+			Audio->MusicLoader.join();
+#endif
+			SetMusicVolume(Audio->BackgroundMusic, 1.0f);
+			PlayMusicStream(Audio->BackgroundMusic);
+			Audio->MusicIsPlaying = true;
+			
+			TraceLog(LOG_INFO, "Music started %.1f ms after the click", 1000.0*(GetTime() - Audio->ClickTime));
+		}
 	}
 	
-	NewBullet->IsBullet = true;
-	NewBullet->Distance = Things[FrameAlienIndex].Distance;
-	NewBullet->Speed    = -5.0f;
-	NewBullet->Billboard = BulletBillboard;
-	NewBullet->Tint      = WHITE;
+	if(Audio->MusicIsPlaying)
+		UpdateMusicStream(Audio->BackgroundMusic);
+#endif
+	
+	Audio->IsClickFrame = false;
 }
 
 void
-DeleteBullet(thing *Bullet, int *FirstFreeThing)
+CloseAudio(audio_startup *Audio)
 {
-	Bullet->IsDeleted = true;
+#ifdef MUSIC_STREAM_DECODER
+	CloseMusicStreamer(&MusicStreamer);
+#else
+#ifdef ASSET_LOADER_THREADS
+	if(Audio->MusicLoader.joinable())
+		Audio->MusicLoader.join();
+#endif
 	
-	Bullet->NextIDInFreeList = *FirstFreeThing;
-	*FirstFreeThing = Bullet->ID;
+	if(Audio->MusicIsLoaded)
+		UnloadMusicStream(Audio->BackgroundMusic);
+#endif
+	if(EngineMixer.IsPlaying)
+		UnloadAudioStream(EngineMixer.Stream);
+	if(SfxMixer.IsPlaying)
+		UnloadAudioStream(SfxMixer.Stream);
+	if(Audio->DeviceIsOpen)
+		CloseAudioDevice();
 }
 
+//NOTE(moritz): The checks in code/tests include this file for its functions and bring their own main
+#ifndef SYNTH_FORCE_TESTS
 int
 main()
 {
@@ -1179,6 +5521,11 @@ main()
 	InitWindow(ScreenWidth, ScreenHeight, "raylib");
 	SetTargetFPS(60);
 	
+	//NOTE(moritz): Time to first frame, from here until right before the main loop
+	double StartupStartTime = GetTime();
+	bool HasAssetPack = OpenAssetPack(&AssetPack, "assets.pak");
+	DecodeAssetJobs(&AssetLoader, StartupAssetJobs, ArrayCount(StartupAssetJobs));
+	
 	//---------------------------------------------------------
 	
 #ifndef WEB_BUILD
@@ -1200,65 +5547,72 @@ main()
 	
 	//---------------------------------------------------------
 	
-	//NOTE(moritz): Load textures
-	Texture2D TreeTexture = LoadTexture("tree.png");
-	SetTextureFilter(TreeTexture, TEXTURE_FILTER_BILINEAR);
+	//NOTE(moritz): Load textures, the billboards get their mips from the offline bake
+	Color TreeColor = {};
+	Texture2D TreeTexture = LoadBillboardTexture("tree.png", &TreeColor);
 	
-	Texture2D RamenShopRightTexture = LoadTexture("building_right.png");
-	SetTextureFilter(RamenShopRightTexture, TEXTURE_FILTER_BILINEAR);
+	Color RamenShopColor = {};
+	Texture2D RamenShopRightTexture = LoadBillboardTexture("building_right.png", &RamenShopColor);
+	Texture2D RamenShopLeftTexture  = LoadBillboardTexture("building_left.png", &RamenShopColor);
 	
-	Texture2D RamenShopLeftTexture = LoadTexture("building_left.png");
-	SetTextureFilter(RamenShopLeftTexture, TEXTURE_FILTER_BILINEAR);
+	Color SkyscraperColor = {};
+	Texture2D SkyscraperRightTexture = LoadBillboardTexture("skyscraper_right.png", &SkyscraperColor);
+	Texture2D SkyscraperLeftTexture  = LoadBillboardTexture("skyscraper_left.png", &SkyscraperColor);
 	
-	Texture2D SkyscraperRightTexture = LoadTexture("skyscraper_right.png");
-	SetTextureFilter(SkyscraperRightTexture, TEXTURE_FILTER_BILINEAR);
+	Color LanternColor = {};
+	Texture2D LanternLeftTexture  = LoadBillboardTexture("lantern_left.png", &LanternColor);
+	Texture2D LanternRightTexture = LoadBillboardTexture("lantern_right.png", &LanternColor);
 	
-	Texture2D SkyscraperLeftTexture = LoadTexture("skyscraper_left.png");
-	SetTextureFilter(SkyscraperLeftTexture, TEXTURE_FILTER_BILINEAR);
-	
-	Texture2D LanternLeftTexture = LoadTexture("lantern_left.png");
-	SetTextureFilter(LanternLeftTexture, TEXTURE_FILTER_BILINEAR);
-	
-	Texture2D LanternRightTexture = LoadTexture("lantern_right.png");
-	SetTextureFilter(LanternRightTexture, TEXTURE_FILTER_BILINEAR);
-	
-	Texture2D CarTexture = LoadTexture("player_car.png");
+	Texture2D CarTexture = LoadTextureAsset("player_car.png");
 	SetTextureFilter(CarTexture, TEXTURE_FILTER_BILINEAR);
 	
-	Texture2D SunsetTexture = LoadTexture("sunset.png");
+	Texture2D SunsetTexture = LoadTextureAsset("sunset.png");
 	SetTextureFilter(SunsetTexture, TEXTURE_FILTER_BILINEAR);
 	Image SunImage = LoadImageFromTexture(SunsetTexture);  
 	
-	Texture2D cross_hair_texture = LoadTexture("crosshair.png");
+	Texture2D cross_hair_texture = LoadTextureAsset("crosshair.png");
 	SetTextureFilter(cross_hair_texture, TEXTURE_FILTER_BILINEAR);
 	
-	Texture2D CivilianTexture = LoadTexture("civil_car.png");
-	SetTextureFilter(CivilianTexture, TEXTURE_FILTER_BILINEAR);
-	
-	Texture2D AlienTexture = LoadTexture("alien.png");
-	Image AlienImage = LoadImageFromTexture(AlienTexture);
+	Color CivilianColor = {};
+	Texture2D CivilianTexture = LoadBillboardTexture("civil_car.png", &CivilianColor);
+	alpha_mask CivilianPickMask = {};
+	BuildBillboardAlphaMask(&CivilianPickMask, "civil_car.png");
+	
+	//NOTE(moritz): Alien and bullets get picked against their level 0 pixels, so no mips for them
+	Image AlienImage = LoadImageAsset("alien.png");
+	Texture2D AlienTexture = LoadTextureFromImage(AlienImage);
+	Color AlienColor = AverageImageColor(AlienImage);
+	alpha_mask AlienPickMask = {};
+	BuildAlphaMask(&AlienPickMask, AlienImage);
+	UnloadImage(AlienImage);
 	//SetTextureFilter(AlienTexture, TEXTURE_FILTER_N);
 	
-	Texture2D BulletTexture = LoadTexture("emp.png");
+	Image BulletImage = LoadImageAsset("emp.png");
+	Texture2D BulletTexture = LoadTextureFromImage(BulletImage);
+	Color BulletColor = AverageImageColor(BulletImage);
+	alpha_mask BulletPickMask = {};
+	BuildAlphaMask(&BulletPickMask, BulletImage);
+	UnloadImage(BulletImage);
 	
 	
 	struct _dithered_horizon {
 		Vector2 position = {0, 0};
 		Vector2 anchor = {400, 129};
-		Texture2D dithered_horizon_texture = LoadTexture("dithered_horizon.png");
+		Texture2D dithered_horizon_texture = LoadTextureAsset("dithered_horizon.png");
 		
 		float displacement_amount = -2;
 		float runtime = 0.0f;
-		void draw(float delta_time) {
+		
+		//NOTE(moritz): Whole pixels, like DrawTexture used to round it. The drawing happens in the background cache
+		int update(float delta_time) {
 			runtime += delta_time;
 			
 			float cur_displacement = sin(runtime * 2) * displacement_amount;
-			
-			rlPushMatrix();
-			rlTranslatef( position.x, position.y, 0);
-			rlTranslatef(-anchor.x, -anchor.y, 0);
-			DrawTexture(dithered_horizon_texture, 0, cur_displacement, WHITE);
-			rlPopMatrix();
+			return (int)cur_displacement;
+		}
+		
+		Vector2 top_left() {
+			return {position.x - anchor.x, position.y - anchor.y};
 		}
 	} dithered_horizon = {/*.position = */{ScreenWidth/2.f, ScreenHeight/2.f}};
 	
@@ -1275,8 +5629,8 @@ main()
 			Vector2 anchor;
 			Texture2D texture;
 		} frames[2] = { 
-			{ {28,21}, LoadTexture("crosshair0.png")}, 
-			{ {26,27}, LoadTexture("crosshair1.png")}
+			{ {28,21}, LoadTextureAsset("crosshair0.png")}, 
+			{ {26,27}, LoadTextureAsset("crosshair1.png")}
 		};
 		
 		int calculate_current_frame() {
@@ -1319,8 +5673,8 @@ main()
 			Vector2 anchor;
 			Texture2D texture;
 		} frames[2] = { 
-			{ {11, 1}, LoadTexture("fire0.png")}, 
-			{ {22, 8}, LoadTexture("fire1.png")}
+			{ {11, 1}, LoadTextureAsset("fire0.png")}, 
+			{ {22, 8}, LoadTextureAsset("fire1.png")}
 		};
 		
 		int calculate_current_frame() {
@@ -1398,7 +5752,7 @@ main()
 		Vector2 position = {0, 0};
 		float orientation = 0.f;
 		float scale = 1.f;
-		Texture2D texture = LoadTexture("car_plain.png");
+		Texture2D texture = LoadTextureAsset("car_plain.png");
 		Vector2 anchor = {75, 68};
 		
 		float runtime = 0.f;
@@ -1411,7 +5765,7 @@ main()
 		
 		struct _shadow {
 			Vector2 anchor = {72, -15};
-			Texture2D shadow_tex = LoadTexture("car_shadow.png");
+			Texture2D shadow_tex = LoadTextureAsset("car_shadow.png");
 			
 			void draw(float parent_orientation, float lift) {
 				rlPushMatrix();
@@ -1465,31 +5819,6 @@ main()
 	SetTextureWrap(car.fire_animation2.frames[0].texture, TEXTURE_WRAP_CLAMP);
 	SetTextureWrap(car.fire_animation2.frames[1].texture, TEXTURE_WRAP_CLAMP);
 	
-	/*
-TODO(moritz): If we want to use mipmaps for our
-billboards (I think we should), then it seems like
-we can't just generate them at startup... This only
-works for native builds of the game. Not for wasm builds...
-So the mips need to get generated offline.
-And then the game loads in the textures with mipmaps included.
-*/
-#if 0
-	//NOTE(moritz): Load textures
-	Texture2D TreeTexture = LoadTexture("tree.png");
-	//SetTextureFilter(TreeTexture, TEXTURE_FILTER_BILINEAR);
-	GenTextureMipmaps(&TreeTexture);
-	SetTextureFilter(TreeTexture, TEXTURE_FILTER_TRILINEAR);
-#endif
-	
-#if 0
-	//NOTE(moritz): Alternative attempt at texture loading,
-	//since GenTextureMipmaps seems to fail for wasm builds
-	Image TreeImage = LoadImage("tree.png");
-	ImageMipmaps(&TreeImage);
-	Texture2D TreeTexture = LoadTextureFromImage(TreeImage);
-	SetTextureFilter(TreeTexture, TEXTURE_FILTER_TRILINEAR);
-	SetTextureWrap(TreeTexture, TEXTURE_WRAP_CLAMP);
-#endif
 	//---------------------------------------------------------
 	
 	//NOTE(moritz): Depth related
@@ -1517,190 +5846,94 @@ And then the game loads in the textures with mipmaps included.
 	
 	//---------------------------------------------------------
 	
-	random_series RoadEntropy = {420};
+	unsigned int RoadSeed = 420;
+	random_series RoadEntropy = {RoadSeed};
 	
 	//NOTE(moritz): Billboards and things
-	billboard RamenShopSprite;
+	billboard RamenShopSprite = {};
 	RamenShopSprite.SpriteScale = 2.0f;
 	RamenShopSprite.SpriteVerticalTweak = 0.15f;
 	RamenShopSprite.TextureLeft  = RamenShopLeftTexture;
 	RamenShopSprite.TextureRight = RamenShopRightTexture;
+	RamenShopSprite.ImpostorColor = RamenShopColor;
 	
-	billboard SkyscraperSprite;
+	billboard SkyscraperSprite = {};
 	SkyscraperSprite.SpriteScale = 10.0f;
 	SkyscraperSprite.SpriteVerticalTweak = 0.02f;
 	SkyscraperSprite.TextureLeft = SkyscraperLeftTexture;
 	SkyscraperSprite.TextureRight = SkyscraperRightTexture;
+	SkyscraperSprite.ImpostorColor = SkyscraperColor;
 	
-	billboard TreeSprite;
+	billboard TreeSprite = {};
 	TreeSprite.SpriteScale = 6.0f;
 	TreeSprite.SpriteVerticalTweak = 0.06f;
 	TreeSprite.TextureLeft  = TreeTexture;
 	TreeSprite.TextureRight = TreeTexture;
+	TreeSprite.ImpostorColor = TreeColor;
 	
-	billboard LanternSprite;
+	billboard LanternSprite = {};
 	LanternSprite.SpriteScale = 2.0f;
 	LanternSprite.SpriteVerticalTweak = 0.05f;
 	//LanternSprite.Texture = LanternTexture;
 	LanternSprite.TextureLeft = LanternLeftTexture;
 	LanternSprite.TextureRight = LanternRightTexture;
+	LanternSprite.ImpostorColor = LanternColor;
 	
-	billboard CivilianSprite;
+	billboard CivilianSprite = {};
 	CivilianSprite.SpriteScale = 1.5f;
 	CivilianSprite.SpriteVerticalTweak = 0.1f;
 	CivilianSprite.TextureRight = CivilianTexture;
 	CivilianSprite.TextureLeft = CivilianTexture;
+	CivilianSprite.PickMask = &CivilianPickMask;
+	CivilianSprite.ImpostorColor = CivilianColor;
 	
-	billboard AlienSprite;
+	billboard AlienSprite = {};
 	AlienSprite.SpriteScale = 3.0f;
 	AlienSprite.SpriteVerticalTweak = -0.6f;
 	AlienSprite.TextureRight = AlienTexture;
 	AlienSprite.TextureLeft  = AlienTexture;
+	AlienSprite.PickMask     = &AlienPickMask;
+	AlienSprite.ImpostorColor = AlienColor;
 	
-	billboard BulletSprite;
+	billboard BulletSprite = {};
 	BulletSprite.SpriteScale = 1.0f;
 	BulletSprite.SpriteVerticalTweak = 0.0f;
 	BulletSprite.TextureRight = BulletTexture;
 	BulletSprite.TextureLeft  = BulletTexture;
+	BulletSprite.PickMask     = &BulletPickMask;
+	BulletSprite.ImpostorColor = BulletColor;
 	
 	//NOTE(moritz): Side bands.. 4?  32 per side band? times two for left/ right side
-	thing Things[256] = {};
-	//thing *FirstFreeThing = FreeThings;
-	int FirstFreeThing = -1;
-	
-	for(int ThingIndex = 0;
-		ThingIndex < ArrayCount(Things);
-		++ThingIndex)
-	{
-		Things[ThingIndex].ID = ThingIndex;
-	}
-	
-	int SideBandIndex = 0;
-	
-	//NOTE(moritz): Init things...
-	
-	int ThingsPerSide = THINGS_PER_BAND*4;
-	
-	//NOTE(moritz): Right side
-	//float MaxPlaceDistance = -F32Max;
-	float BandMaxPlaceDistances[4] = {};
-	float CurrentDistance = 0.0f;
-	for(int ThingIndex = 0;
-		ThingIndex < ThingsPerSide;
-		++ThingIndex)
-	{
-		SideBandIndex = ThingIndex/THINGS_PER_BAND;
-		
-		Things[ThingIndex].BandIndex = SideBandIndex + 1;
-		
-		float fSideBand = (float)SideBandIndex; //0 is lamps
-		
-		Things[ThingIndex].Distance = CurrentDistance;
-		
-		Things[ThingIndex].RoadSide = 1.0f;
-		
-		Things[ThingIndex].Tint = WHITE;
-		
-		float DistanceSpacing;
-		
-		if(SideBandIndex == 0)
-		{
-			Things[ThingIndex].Billboard = &LanternSprite;
-			DistanceSpacing = 5.0f + 10.0f*RandomUnilateral(&RoadEntropy);
-		}
-		else if(SideBandIndex == 1)
-		{
-			float TreeRand = 2.0f*RandomUnilateral(&RoadEntropy);
-			
-			Things[ThingIndex].XOffset = 400.0f*fSideBand + RandomBilateral(&RoadEntropy)*50.0f;
-			
-			if(TreeRand > 1.0f)
-				Things[ThingIndex].Billboard = &RamenShopSprite;
-			else
-				Things[ThingIndex].Billboard = &TreeSprite;
-			
-			DistanceSpacing = 10.0f + 30.0f*RandomUnilateral(&RoadEntropy);
-			
-		}
-		else
-		{
-			Things[ThingIndex].XOffset = 800.0f*fSideBand + RandomBilateral(&RoadEntropy)*200.0f;
-			Things[ThingIndex].Billboard = &SkyscraperSprite;
-			
-			DistanceSpacing = 30.0f + 40.0f*RandomUnilateral(&RoadEntropy);
-		}
-		
-		
-		CurrentDistance += DistanceSpacing;
-		
-		BandMaxPlaceDistances[SideBandIndex] = Max(BandMaxPlaceDistances[SideBandIndex], CurrentDistance);
-		
-		//MaxPlaceDistance = Max(MaxPlaceDistance, CurrentDistance);
-		
-		//NOTE(moritz): Prep next band filling
-		if(((ThingIndex + 1)/THINGS_PER_BAND) > SideBandIndex)
-			CurrentDistance = 0.0f;
-	}
-	
-	//NOTE(moritz): Left side
-	SideBandIndex = 0;
-	int ThingIndexOffset = ThingsPerSide;
-	CurrentDistance = 0.0f;
-	for(int ThingIndex = ThingsPerSide;
-		ThingIndex < (2*ThingsPerSide);
-		++ThingIndex)
-	{
-		SideBandIndex = (ThingIndex - ThingIndexOffset)/THINGS_PER_BAND;
-		
-		Things[ThingIndex].BandIndex = SideBandIndex + 1;
-		
-		float fSideBand = (float)SideBandIndex; //0 is lamps
-		
-		Things[ThingIndex].Tint = WHITE;
-		
-		Things[ThingIndex].RoadSide = -1.0f;
-		Things[ThingIndex].Distance = CurrentDistance;
-		
-		float DistanceSpacing;
-		
-		if(SideBandIndex == 0)
-		{
-			Things[ThingIndex].Billboard = &LanternSprite;
-			DistanceSpacing = 5.0f + 10.0f*RandomUnilateral(&RoadEntropy);
-		}
-		else if(SideBandIndex == 1)
-		{
-			float TreeRand = 2.0f*RandomUnilateral(&RoadEntropy);
-			
-			Things[ThingIndex].XOffset = -400.0f*fSideBand + RandomBilateral(&RoadEntropy)*50.0f;
-			
-			if(TreeRand > 1.0f)
-				Things[ThingIndex].Billboard = &RamenShopSprite;
-			else
-				Things[ThingIndex].Billboard = &TreeSprite;
-			
-			DistanceSpacing = 10.0f + 30.0f*RandomUnilateral(&RoadEntropy);
-		}
-		else
-		{
-			Things[ThingIndex].XOffset = -800.0f*fSideBand + RandomBilateral(&RoadEntropy)*200.0f;
-			Things[ThingIndex].Billboard = &SkyscraperSprite;
-			
-			DistanceSpacing = 30.0f + 40.0f*RandomUnilateral(&RoadEntropy);
-		}
-		
-		CurrentDistance += DistanceSpacing;
-		
-		BandMaxPlaceDistances[SideBandIndex] = Max(BandMaxPlaceDistances[SideBandIndex], CurrentDistance);
-		
-		//MaxPlaceDistance = Max(MaxPlaceDistance, CurrentDistance);
-		
-		//NOTE(moritz): Prep next band filling
-		if(((ThingIndex + 1 - ThingIndexOffset)/THINGS_PER_BAND) > SideBandIndex)
-			CurrentDistance = 0.0f;
-	}
-	
-	int NumberOfThings = 2*ThingsPerSide;
+	thing_store ThingStore = {};
+	InitThingStore(&ThingStore, THING_STORE_CAPACITY, ThingOverflow_RecycleFarthest);
+	
+	//NOTE(moritz): Scenery bands, lamps first, then further and further away from the road
+	scenery Scenery = {};
+	Scenery.Bands[0] = {5.0f,  10.0f,    0.0f,   0.0f, {&LanternSprite,    &LanternSprite}};
+	Scenery.Bands[1] = {10.0f, 30.0f,  400.0f,  50.0f, {&TreeSprite,       &RamenShopSprite}};
+	Scenery.Bands[2] = {30.0f, 40.0f, 1600.0f, 200.0f, {&SkyscraperSprite, &SkyscraperSprite}};
+	Scenery.Bands[3] = {30.0f, 40.0f, 2400.0f, 200.0f, {&SkyscraperSprite, &SkyscraperSprite}};
+	InitScenery(&Scenery, RoadSeed, MaxDistance);
+	StreamScenery(&Scenery, &ThingStore, 0.0f);
+	
+	//NOTE(moritz): Collision broad-phase
+	float BaseRoadHalfWidth = fScreenWidth*0.8f;
+	thing_grid ThingGrid = {};
+	InitThingGrid(&ThingGrid, ThingStore.Capacity);
+	
+	//NOTE(moritz): Narrow phase scratch, sized so every thing in the grid fits
+	int CandidateCapacity = ThingGrid.ThingCapacity;
+	int *CandidateIDs            = (int *)malloc(sizeof(int)*CandidateCapacity);
+	float *CandidateStartX       = (float *)malloc(sizeof(float)*CandidateCapacity);
+	float *CandidateStartY       = (float *)malloc(sizeof(float)*CandidateCapacity);
+	float *CandidateEndX         = (float *)malloc(sizeof(float)*CandidateCapacity);
+	float *CandidateEndY         = (float *)malloc(sizeof(float)*CandidateCapacity);
+	thing **CandidateThings      = (thing **)malloc(sizeof(thing *)*CandidateCapacity);
+	unsigned int *CandidateHits  = (unsigned int *)malloc(sizeof(unsigned int)*((CandidateCapacity + 31)/32));
+	
+	//NOTE(moritz): Picking
+	pick_grid *PickGrid = (pick_grid *)malloc(sizeof(pick_grid));
+	InitPickGrid(PickGrid, ScreenWidth, ScreenHeight);
 	
 	//NOTE(moritz): Civilian cars
 	float CivCarSpacing = 20.0f;
@@ -1713,24 +5946,17 @@ And then the game loads in the textures with mipmaps included.
 		
 		CivCarSpacing += RandomBilateral(&RoadEntropy)*2.0f;
 		
-		Things[NumberOfThings].Billboard = &CivilianSprite;
-		Things[NumberOfThings].Speed     = 10.0f;
-		Things[NumberOfThings].Distance  = CivCarDist + (float)CivCarIndex * CivCarSpacing;
-		Things[NumberOfThings].XOffset   = 200.0f*RoadSide;
-		Things[NumberOfThings].Tint      = WHITE;
-		++NumberOfThings;
+		thing *Thing = SpawnThing(&ThingStore);
+		Thing->Billboard = &CivilianSprite;
+		Thing->Speed     = 10.0f;
+		Thing->Distance  = CivCarDist + (float)CivCarIndex * CivCarSpacing;
+		Thing->XOffset   = 200.0f*RoadSide;
+		Thing->Tint      = WHITE;
 	}
 	
 	//NOTE(moritz): Alien :O
-	Things[NumberOfThings].Billboard = &AlienSprite;
-	Things[NumberOfThings].Speed     = 10.0f;
-	Things[NumberOfThings].Distance  = 10.0f;
-	Things[NumberOfThings].XOffset   = 0.0f;
-	Things[NumberOfThings].Tint      = WHITE;
-	Things[NumberOfThings].IsAlien   = true;
-	Things[NumberOfThings].ShootTimer = 1.0f;
-	
-	++NumberOfThings;
+	//Aliens come in waves now, the first one is the lone alien from before
+	wave_state Waves = {};
 	
 	
 	//---------------------------------------------------------
@@ -1745,6 +5971,8 @@ And then the game loads in the textures with mipmaps included.
 		fScreenHeight - 60.0f // - (float)CarTexture.height
 	};
 	float PlayerColHalfLength = 0.0f;
+	float PlayerColLateral    = 0.0f;
+	bool PlayerColLateralIsValid = false;
 	
 	float PlayerBaseXOffset = 0.0f;
 	
@@ -1761,15 +5989,28 @@ And then the game loads in the textures with mipmaps included.
 	
 	road_pool RoadPool      = {};
 	road_list ActiveRoadList = {};
+	road_list PendingRoadList = {};
 	
 	road_segment *InitialRoadSegment = AllocateRoadSegment(&RoadPool);
 	
 	InitialRoadSegment->Position = 0.0f;
 	
 	InitialRoadSegment->ddX = 0.0f;
+	InitSegmentBezier(InitialRoadSegment, 0, 0, MaxDistance);
+	SetRoadSegmentLUTs(&InitialRoadSegment, 1);
 	
 	Append(&ActiveRoadList, InitialRoadSegment);
 	
+	road_model RoadModel = RoadModel_ddX;
+	
+	road_curvature RoadCurvature = {};
+	AllocateRoadCurvature(&RoadCurvature, DepthLineCount, MaxDistance, CameraHeight);
+	road_benchmark RoadBenchmark = {};
+	
+	//NOTE(moritz): Screen x of the road center per depth line, recomputed once per frame
+	float *RoadCenterX = (float *)malloc(sizeof(float)*DepthLineCount);
+	ZeroSize(RoadCenterX, sizeof(float)*DepthLineCount);
+	
 	//---------------------------------------------------------
 	
 	float TreeDistance = MaxDistance;
@@ -1783,45 +6024,81 @@ And then the game loads in the textures with mipmaps included.
 	//---------------------------------------------------------
 	
 	RenderTexture2D TargetTexture = LoadRenderTexture(ScreenWidth, ScreenHeight);
+	background_cache BackgroundCache = {};
 	
 	//---------------------------------------------------------
-	Music Music = {};
+	audio_startup AudioStartup = {};
+	AudioStartup.MusicBytes = LoadFileAsset("music.mp3", &AudioStartup.MusicByteCount);
 	
-	Sound lazer_shot;
-	Sound crosshair_blip;
+	//NOTE(moritz): Sfx get mixed on the audio thread, see SfxMixerCallback
+	LoadSfxSamples(&SfxMixer);
+	
+	//NOTE(moritz): Engine layers get mixed on the audio thread, see EngineMixerCallback
+	LoadEngineBank(&EngineMixer);
 	
 	struct _EngineSoundState  {
-		Sound engine;
-		
 		void load() {
-			engine = LoadSound("engine.wav");
-			SetSoundVolume(engine, .5);
-		}
-		
-		void playInLoop(float pitch) {
-			SetSoundPitch(engine, pitch);
-			if(!IsSoundPlaying(engine)) {
-				PlaySound(engine);
-			}
+			StartEngineMixer(&EngineMixer);
 		}
 		
 		void update(float velocity) {
 			float max_speed = 20;
-			float max_pitch = 2;
-			float cur_pitch = ClampM(0.f, velocity / max_speed,1.f) * 2.f;
-
-			playInLoop(cur_pitch);
+			SetEngineRpm(&EngineMixer, velocity / max_speed);
 		}
 	} engine_sound_state;
 	
 	_Skyline skyline(ScreenWidth, ScreenHeight);
 	
 	bool ShowHighScore = false;
+	bool ShowFrameStats = false;
 	
 	//NOTE(moritz): Main loop
 	//TODO(moritz): Mind what is said about main loops for wasm apps...
+	TraceLog(LOG_INFO, "Startup took %.1f ms (%s)", 1000.0*(GetTime() - StartupStartTime),
+			 HasAssetPack ? (AssetPack.IsMapped ? "mapped asset pack" : "asset pack") : "loose files");
+	
 	while(!WindowShouldClose())
 	{
+		double FrameWorkStartTime = GetTime();
+		FrameStats = {};
+		FrameStats.AudioLatencyLast     = SfxMixer.LatencyLast.load(std::memory_order_relaxed);
+		FrameStats.AudioLatencyMax      = SfxMixer.LatencyMax.load(std::memory_order_relaxed);
+		FrameStats.AudioCommandsDropped = SfxMixer.DroppedCommandCount;
+		FrameStats.SfxVoicesActive      = SfxMixer.ActiveVoiceCount.load(std::memory_order_relaxed);
+		FrameStats.SfxVoiceCount        = SFX_VOICE_COUNT;
+		FrameStats.SfxVoicesStolen      = SfxMixer.StolenVoiceCount.load(std::memory_order_relaxed);
+		FrameStats.SfxPlaysRejected     = SfxMixer.RejectedPlayCount.load(std::memory_order_relaxed);
+		FrameStats.SfxPlaysCapped       = SfxMixer.CappedPlayCount;
+		BeginSfxFrame(&SfxMixer);
+#ifdef MUSIC_STREAM_DECODER
+		FrameStats.MusicPrefetchBlocks = MusicStreamer.PrefetchBlocks.load(std::memory_order_relaxed);
+		FrameStats.MusicBufferedBlocks = (int)(MusicStreamer.WriteIndex.load(std::memory_order_relaxed) -
+											   MusicStreamer.ReadIndex.load(std::memory_order_relaxed));
+		FrameStats.MusicUnderruns      = MusicStreamer.UnderrunCount.load(std::memory_order_relaxed);
+		FrameStats.MusicDecodeSpeed    = MusicStreamer.DecodeSpeed.load(std::memory_order_relaxed);
+#endif
+		
+		if(IsKeyPressed(KEY_F1))
+			ShowFrameStats = !ShowFrameStats;
+		
+		if(IsKeyPressed(KEY_F2))
+			RoadModel = (road_model)((RoadModel + 1) % RoadModel_Count);
+		
+		if(IsKeyPressed(KEY_F3))
+			BenchmarkRoadModels(&RoadBenchmark, RoadCenterX, DepthLineCount, fScreenWidth,
+								&ActiveRoadList, PlayerBaseXOffset);
+		
+		if(IsKeyPressed(KEY_F4))
+		{
+			Waves.Stress = !Waves.Stress;
+			Waves.StressLogTimer = STRESS_LOG_INTERVAL;
+			
+			if(Waves.Stress)
+				SpawnWave(&Waves, &StressWave, STRESS_WAVE_INDEX, &ThingStore, &AlienSprite);
+			else
+				DespawnWave(&Waves, STRESS_WAVE_INDEX, &ThingStore);
+		}
+		
 		//NOTE(moritz): Audio stuff has to get initialised like this,
 		//Otherwise the browser (Chrome) complains... Audio init after user input
 		if(IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
@@ -1833,19 +6110,13 @@ And then the game loads in the textures with mipmaps included.
 			if(!AudioIsInitialised)
 			{
 				AudioIsInitialised = true;
-				InitAudioDevice();
-				
-				//NOTE(moritz): Load music and sfx here
-				Music = LoadMusicStream("music.mp3");
+				OpenAudio(&AudioStartup);
 				
-				SetMusicVolume(Music, 1.0f);
-				PlayMusicStream(Music);
-				
-				// Load audio
-				lazer_shot = LoadSound("lazer.wav");
-				crosshair_blip = LoadSound("crosshair_blip.wav");
-				SetSoundVolume(crosshair_blip, .5);
+				//NOTE(moritz): Already decoded at startup, this is just handing them to the mixer
+				StartSfxMixer(&SfxMixer);
 				engine_sound_state.load();
+				
+				TraceLog(LOG_INFO, "Audio init on click took %.2f ms", 1000.0*(GetTime() - AudioStartup.ClickTime));
 			}
 		}
 		
@@ -1967,9 +6238,8 @@ And then the game loads in the textures with mipmaps included.
 			
 			if(ActiveRoadList.Last->Position < 1.0f)
 			{
-				road_segment *NewSegment = AllocateRoadSegment(&RoadPool);
-				
-				InitSegment(NewSegment, ActiveRoadList.Last, &RoadEntropy, MaxDistance);
+				road_segment *NewSegment = NextRoadSegment(&RoadPool, &PendingRoadList, ActiveRoadList.Last,
+														   &RoadEntropy, MaxDistance);
 				
 				Append(&ActiveRoadList, NewSegment);
 			}
@@ -1979,24 +6249,32 @@ And then the game loads in the textures with mipmaps included.
 			{
 				DeleteHeadSegment(&ActiveRoadList, &RoadPool);
 				
-				road_segment *NewSegment = AllocateRoadSegment(&RoadPool);
-				
-				InitSegment(NewSegment, ActiveRoadList.Last, &RoadEntropy, MaxDistance);
+				road_segment *NewSegment = NextRoadSegment(&RoadPool, &PendingRoadList, ActiveRoadList.Last,
+														   &RoadEntropy, MaxDistance);
 				
 				Append(&ActiveRoadList, NewSegment);
 			}
 			
-			float CurveForceT = 1.0f - ActiveRoadList.First->Next->Position;;
+			//NOTE(moritz): The player feels the average bend of the whole visible road.
+			//For the ddX model that is the old lerp between the first two segments' ddX, weighted by screen coverage.
+			ComputeRoadCurvature(RoadModel, &RoadCurvature, &ActiveRoadList);
+			float CurveForce = PlayerSpeed*TWEAK(50.0f)*RoadCurvatureAt(&RoadCurvature, 0.0f, F32Max);
 			
-			CurveForceT = ClampM(0.0f, CurveForceT, 1.0f);
-			
-			float CurveForce = PlayerSpeed*TWEAK(50.0f)*LerpM(ActiveRoadList.First->ddX, CurveForceT, ActiveRoadList.First->Next->ddX);
+			FrameStats.RoadModel = RoadModel;
+			FrameStats.PlayerCurvature = RoadCurvatureAt(&RoadCurvature, 0.0f, 1.0f);
+			FrameStats.NextInflectionDistance = RoadNextInflection(&RoadCurvature, 0.0f);
 			
 			PlayerBaseXOffset += CurveForce;
 			
 			float OffRoadLimit = TWEAK(1000.0f);
 			PlayerBaseXOffset = ClampM(-OffRoadLimit, PlayerBaseXOffset, OffRoadLimit);
 			
+			//NOTE(moritz): Road center per depth line, shared by the road and billboards this frame
+			double RoadPassStartTime = GetTime();
+			ComputeRoadCenterX(RoadModel, RoadCenterX, DepthLineCount, fScreenWidth,
+							   &ActiveRoadList, PlayerBaseXOffset);
+			FrameStats.RoadPassSeconds = GetTime() - RoadPassStartTime;
+			
 			
 			
 #if 0
@@ -2005,160 +6283,299 @@ And then the game loads in the textures with mipmaps included.
 			if((TreeDistance < 0.0f)/* && NewBottomSegment*/) //TODO(moritz): poor man's way of syncing tree spawn with segment swap to avoid weird bug
 				TreeDistance = MaxDistance + 1.0f;
 #endif
-			//NOTE(moritz): Update thing positions
-			for(int ThingIndex = 0;
-				ThingIndex < NumberOfThings;
-				++ThingIndex)
+			//NOTE(moritz): Update thing positions.
+			//Things that passed the camera last tick get recycled first, so the collision sweep
+			//still saw the whole way they travelled in the tick they crossed.
+			float MaxThingTravel = 0.0f;
+			Waves.AlienCount  = 0;
+			Waves.BulletCount = 0;
+			for(int ID = 0;
+				ID < ThingStore.Count;
+				++ID)
 			{
-				if(Things[ThingIndex].IsDeleted)
-					continue;
+				thing *Thing = GetThing(&ThingStore, ID);
 				
-				Things[ThingIndex].Distance += -dPlayerP + Things[ThingIndex].Speed*dtForFrame;
+				if(Thing->IsDeleted)
+					continue;
 				
-				if(Things[ThingIndex].Distance < 0.0f)
+				if(Thing->Distance < 0.0f)
 				{
-					int BandIndex = Things[ThingIndex].BandIndex - 1;
-					if(BandIndex < 0)
-						BandIndex = 1;
-					
-					Things[ThingIndex].Distance = BandMaxPlaceDistances[BandIndex];
+					//NOTE(moritz): Scenery and bullets retire, civilian cars come round again
+					if(Thing->IsBullet || (Thing->BandIndex > 0))
+					{
+						DeleteThing(&ThingStore, Thing);
+						continue;
+					}
 					
-					if(Things[ThingIndex].IsBullet)
-						DeleteBullet(Things + ThingIndex, &FirstFreeThing);
+					Thing->Distance = Scenery.LookAheadDistance;
 				}
-				//Things[ThingIndex].Distance = MaxPlaceDistance;
+				
+				if(Thing->BandIndex > 0)
+					++FrameStats.SceneryCount;
+				
+				if(Thing->IsAlien)
+					++Waves.AlienCount;
+				if(Thing->IsBullet)
+					++Waves.BulletCount;
+				
+				Thing->PrevDistance = Thing->Distance;
+				Thing->Distance += -dPlayerP + Thing->Speed*dtForFrame;
+				
+				MaxThingTravel = Max(MaxThingTravel, fabsf(Thing->Distance - Thing->PrevDistance));
 			}
 			
-			//NOTE(moritz): Sort thing positions back to front
-			bool SwapHappened = false;
-			for(int Outer = 0;
-				Outer < NumberOfThings;
+			//NOTE(moritz): Top up the scenery window, after the update so new things start where they are spawned
+			StreamScenery(&Scenery, &ThingStore, dPlayerP);
+			
+			//NOTE(moritz): Sort thing positions back to front. Only the draw order gets sorted, things stay put.
+			//Insertion sort, the order barely changes between frames, so this is close to a single pass.
+			//Only freshly spawned things (at the end of the list) have to travel.
+			thing **SortedThings = ThingStore.SortedThings;
+			for(int Outer = 1;
+				Outer < ThingStore.Count;
 				++Outer)
 			{
-				SwapHappened = false;
+				thing *Temp = SortedThings[Outer];
 				
-				for(int Inner = 0;
-					Inner < (NumberOfThings - 1);
-					++Inner)
+				int Inner = Outer;
+				while((Inner > 0) && (SortedThings[Inner - 1]->Distance < Temp->Distance))
 				{
-					thing *EntryA = Things + Inner;
-					thing *EntryB = Things + Inner + 1;
-					
-					if(EntryA->Distance < EntryB->Distance)
-					{
-						thing Temp = *EntryA;
-						*EntryA = *EntryB;
-						*EntryB = Temp;
-						
-						SwapHappened = true;
-					}
+					SortedThings[Inner] = SortedThings[Inner - 1];
+					--Inner;
 				}
 				
-				if(!SwapHappened) //NOTE(moritz): Early out
-					break;
+				SortedThings[Inner] = Temp;
 			}
 			
+			UpdateThingGrid(&ThingGrid, &ThingStore, BaseRoadHalfWidth);
+			
 			//NOTE(moritz): Determine thing frame properties
-			int FrameAlienIndex = -1;
-			for(int ThingIndex = 0;
-				ThingIndex < NumberOfThings;
-				++ThingIndex)
+			ClearPickGrid(PickGrid);
+			
+			UpdateWaves(&Waves, dtForFrame, &ThingStore, &AlienSprite);
+			
+			//NOTE(moritz): Back to front, so the pick grid knows what is in front. Spawns in here land at the end.
+			for(int SortIndex = 0;
+				SortIndex < ThingStore.Count;
+				++SortIndex)
 			{
-				if((Things[ThingIndex].Distance <= MaxDistance) &&
-				   (Things[ThingIndex].Distance > 0.1f))
+				thing *Thing = SortedThings[SortIndex];
+				
+				if((Thing->Distance <= MaxDistance) &&
+				   (Thing->Distance > 0.1f))
 				{
-					DetermineThingFrameProperties(Things[ThingIndex].Billboard, Things + ThingIndex,
+					DetermineThingFrameProperties(Thing->Billboard, Thing,
 												  MaxDistance, fScreenWidth, fScreenHeight, DepthLines, DepthLineCount,
-												  CameraHeight, &ActiveRoadList, PlayerBaseXOffset);
+												  CameraHeight, RoadCenterX, PickGrid);
+				}
+				else if(Thing->Distance < 0.0f)
+				{
+					//NOTE(moritz): Passed the camera, waiting to be recycled next tick
+					Thing->DrawMe = false;
 				}
 				
-				if(Things[ThingIndex].IsAlien)
+				if(Thing->IsAlien && !Thing->IsDeleted)
 				{
-					FrameAlienIndex = ThingIndex;
+					thing *Alien = Thing;
 					
-					Things[ThingIndex].ShootTimer -= dtForFrame;
-					
-					if(Things[ThingIndex].ShootTimer < 0.0f)
+					if(Alien->Lifetime < F32Max)
 					{
-						Things[ThingIndex].ShootTimer = 1.0f;
-						AddAlienBullet(Things, &NumberOfThings, &FirstFreeThing, FrameAlienIndex, &BulletSprite);
+						Alien->Lifetime -= dtForFrame;
+						if(Alien->Lifetime <= 0.0f)
+						{
+							DeleteThing(&ThingStore, Alien);
+							--Waves.AlienCount;
+							continue;
+						}
 					}
+					
+					UpdateAlienShooting(&Waves, Alien, dtForFrame, &ThingStore, &BulletSprite);
 				}
 			}
 			
-			//NOTE(moritz): Collision test against the 5? closest things
-			for(int ThingIndex = (NumberOfThings - 1);
-				ThingIndex > (NumberOfThings - 5 - 1);
-				--ThingIndex)
+			/*
+			NOTE(moritz):
+			Player collision sweep (world space: distance x lateral offset from the road center).
+			The player's collision edge sits at a fixed distance in front of the camera. Relative to
+			the player every thing travels from (PrevDistance, Lateral - PrevPlayerLateral) to
+			(Distance, Lateral - PlayerLateral) over the tick, and hits when that path crosses the edge.
+			Laterals get divided by the combined half width, so the edge is the same segment for
+			every thing and the whole candidate list goes through one batched intersection.
+			Nothing here depends on the frame time or on pixels on screen, so hits come out the same
+			no matter how the tick got sliced.
+			*/
+			int PlayerColLine = (int)ClampM(0.0f, fScreenHeight - PlayerColP.y + TWEAK(10.0f), fDepthLineCount - 1.0f);
+			float PlayerColDistance  = DepthLines[PlayerColLine].Depth*MaxDistance;
+			float PlayerColHalfWidth = PlayerColHalfLength/DepthLines[PlayerColLine].Scale;
+			
+			float PrevPlayerColLateral = PlayerColLateral;
+			PlayerColLateral = (PlayerColP.x - RoadCenterX[PlayerColLine])/DepthLines[PlayerColLine].Scale;
+			if(!PlayerColLateralIsValid)
+			{
+				PrevPlayerColLateral = PlayerColLateral;
+				PlayerColLateralIsValid = true;
+			}
+			
+			//NOTE(moritz): Broad-phase. Grid bins things by where they ended the tick,
+			//so reach back by however far anything travelled.
+			int CandidateCount = QueryThingGrid(&ThingGrid,
+												PlayerColDistance - MaxThingTravel - THING_GRID_CELL_DISTANCE,
+												PlayerColDistance + MaxThingTravel + THING_GRID_CELL_DISTANCE,
+												Min(PrevPlayerColLateral, PlayerColLateral) - PlayerColHalfWidth,
+												Max(PrevPlayerColLateral, PlayerColLateral) + PlayerColHalfWidth,
+												CandidateIDs, CandidateCapacity);
+			FrameStats.CollisionCandidates = CandidateCount;
+			if(CandidateCount > CandidateCapacity)
+			{
+				FrameStats.CollisionCandidatesDropped += CandidateCount - CandidateCapacity;
+				CandidateCount = CandidateCapacity;
+			}
+			
+			//NOTE(moritz): Narrow phase. Gather the candidates' relative paths and test them all in one batch.
+			segment_soa CandidateSegments = {};
+			CandidateSegments.Capacity = CandidateCapacity;
+			CandidateSegments.StartX = CandidateStartX;
+			CandidateSegments.StartY = CandidateStartY;
+			CandidateSegments.EndX   = CandidateEndX;
+			CandidateSegments.EndY   = CandidateEndY;
+			
+			for(int CandidateIndex = 0;
+				CandidateIndex < CandidateCount;
+				++CandidateIndex)
 			{
-				if(ThingIndex == FrameAlienIndex)
+				thing *Thing = GetThing(&ThingStore, CandidateIDs[CandidateIndex]);
+				
+				if(Thing->IsDeleted || Thing->IsAlien)
 					continue;
 				
-				thing *Thing = Things + ThingIndex;
+				float ThingLateral = ThingLateralOffset(Thing, BaseRoadHalfWidth);
+				float OneOverReach = 1.0f/(ThingHalfWidth(Thing) + PlayerColHalfWidth);
 				
-				if(Thing->IsDeleted)
+				Vector2 PathStart = {Thing->PrevDistance, (ThingLateral - PrevPlayerColLateral)*OneOverReach};
+				Vector2 PathEnd   = {Thing->Distance,     (ThingLateral - PlayerColLateral)*OneOverReach};
+				
+				CandidateThings[CandidateSegments.Count] = Thing;
+				PushSegment(&CandidateSegments, PathStart, PathEnd);
+			}
+			
+			Vector2 PlayerColStart = {PlayerColDistance, -1.0f};
+			Vector2 PlayerColEnd   = {PlayerColDistance,  1.0f};
+			
+			LineLineIntersectBatch(PlayerColStart, PlayerColEnd, &CandidateSegments, CandidateHits);
+			
+			float ObstacleTOI = F32Max;
+			FrameStats.CollisionTOI = F32Max;
+			
+			for(int SegmentIndex = 0;
+				SegmentIndex < CandidateSegments.Count;
+				++SegmentIndex)
+			{
+				bool Hit = (CandidateHits[SegmentIndex/32] >> (SegmentIndex % 32)) & 1;
+				
+#ifdef COLLISION_VALIDATION
+				Vector2 PathStart = {CandidateStartX[SegmentIndex], CandidateStartY[SegmentIndex]};
+				Vector2 PathEnd   = {CandidateEndX[SegmentIndex], CandidateEndY[SegmentIndex]};
+				if(Hit != LineLineIntersect(PlayerColStart, PlayerColEnd, PathStart, PathEnd))
+					TraceLog(LOG_WARNING, "COLLISION: Batched and scalar intersection disagree for segment %d", SegmentIndex);
+#endif
+				
+				if(!Hit)
 					continue;
 				
+				//NOTE(moritz): A crossing path can't be parallel to the edge, so the distances differ
+				float TOI = (CandidateStartX[SegmentIndex] - PlayerColDistance)/(CandidateStartX[SegmentIndex] - CandidateEndX[SegmentIndex]);
 				
-				Vector2 ThingColP = Thing->FrameBaseP;
-				float ThingColRadius = 0.5f*(float)Thing->Billboard->TextureRight.width*Thing->FrameScale + PlayerColHalfLength;
+				++FrameStats.CollisionHits;
+				FrameStats.CollisionTOI = Min(FrameStats.CollisionTOI, TOI);
 				
-				Vector2 PlayerColStart = PlayerColP;
-				Vector2 PlayerColEnd   = PlayerColP;// + dPlayerP;
-				PlayerColEnd.y += TWEAK(-10.0f) - PlayerSpeed;//-PlayerSpeed;//dPlayerP/**200.0f*/;
+				thing *Thing = CandidateThings[SegmentIndex];
 				
-				Vector2 ThingColStart = ThingColP;
-				ThingColStart.x -= ThingColRadius;
-				Vector2 ThingColEnd = ThingColP;
-				ThingColEnd.x += ThingColRadius;;
-				if(LineLineIntersect(PlayerColStart, PlayerColEnd,
-									 ThingColStart, ThingColEnd))
+				if(Thing->IsBullet)
 				{
-					if(Thing->IsBullet)
-					{
-						DeleteBullet(Thing, &FirstFreeThing);
-						
-						AlienHitCount -= 20;
-						
-						if(AlienHitCount < 0)
-							ShowHighScore = true;
-					}
-					else
-					{
-						PlayerSpeed *= 0.5f;
-						float NewLenkSign = -Sign(PlayerBaseXOffset);//-Sign(ThingColP.x - PlayerColP.x);
-						lenkVelocity = fabs(lenkVelocity)*NewLenkSign;
-						lenkVelocity *=  TWEAK(5.0f)*PlayerSpeed;
-					}
+					DeleteThing(&ThingStore, Thing);
+					
+					AlienHitCount -= 20;
+					
+					if(AlienHitCount < 0)
+						ShowHighScore = true;
 				}
-				
-				//DrawLineEx(PlayerColStart, PlayerColEnd, 2.0f, WHITE);
-				//DrawLineEx(ThingColStart, ThingColEnd, 2.0f, RED);
+				else
+				{
+					ObstacleTOI = Min(ObstacleTOI, TOI);
+				}
+			}
+			
+			//NOTE(moritz): Only the first obstacle hit in a tick bumps the player
+			if(ObstacleTOI < F32Max)
+			{
+				PlayerSpeed *= 0.5f;
+				float NewLenkSign = -Sign(PlayerBaseXOffset);//-Sign(ThingColP.x - PlayerColP.x);
+				lenkVelocity = fabs(lenkVelocity)*NewLenkSign;
+				lenkVelocity *=  TWEAK(5.0f)*PlayerSpeed;
 			}
 			
 			
-			//NOTE(moritz): Basic-ass alien behaviour
-			if(Things[FrameAlienIndex].Distance < TWEAK(9.0f))
-				Things[FrameAlienIndex].Speed += Max( (1.0f/Things[FrameAlienIndex].Distance), 0.05f);
+			//NOTE(moritz): Basic-ass alien behaviour. Every alien keeps to its own hover distance.
+			for(int ID = 0;
+				ID < ThingStore.Count;
+				++ID)
+			{
+				thing *Alien = GetThing(&ThingStore, ID);
+				if(!Alien->IsAlien || Alien->IsDeleted)
+					continue;
+				
+				if(Alien->Distance < Alien->HoverDistance - TWEAK(1.0f))
+					Alien->Speed += Max( (1.0f/Alien->Distance), 0.05f);
+				
+				if(Alien->Distance > Alien->HoverDistance)
+					Alien->Speed -= Min( Alien->Distance*TWEAK(0.05f), 0.5f);
+				
+				if(Alien->Distance < 2.5f)
+					Alien->Distance = 2.5f;
+				
+				if(Alien->Distance > 15.0f)
+					Alien->Distance = 15.0f;
+			}
 			
-			if(Things[FrameAlienIndex].Distance > TWEAK(10.0f))
-				Things[FrameAlienIndex].Speed -= Min( Things[FrameAlienIndex].Distance*TWEAK(0.05f), 0.5f);
+			FrameStats.ThingCount  = ThingStore.Count;
+			FrameStats.ThingBlockCount = ThingStore.BlockCount;
+			FrameStats.ThingOverflowCount = ThingStore.OverflowCount;
+			FrameStats.AlienCount  = Waves.AlienCount;
+			FrameStats.BulletCount = Waves.BulletCount;
+			FrameStats.RefusedSpawnCount = Waves.RefusedSpawnCount;
 			
-			if(Things[FrameAlienIndex].Distance < 2.5f)
-				Things[FrameAlienIndex].Distance = 2.5f;
+			if(Waves.Stress)
+			{
+				Waves.StressLogTimer -= dtForFrame;
+				if(Waves.StressLogTimer <= 0.0f)
+				{
+					Waves.StressLogTimer += STRESS_LOG_INTERVAL;
+					
+					float AverageSeconds, MaxSeconds;
+					SummarizeFrameTimes(&AverageSeconds, &MaxSeconds);
+					TraceLog(LOG_INFO, "STRESS: %d aliens, %d bullets, %d things, frame work avg %.2f ms, max %.2f ms, %d spawns refused",
+							 Waves.AlienCount, Waves.BulletCount, ThingStore.Count,
+							 1000.0f*AverageSeconds, 1000.0f*MaxSeconds, Waves.RefusedSpawnCount);
+				}
+			}
 			
-			if(Things[FrameAlienIndex].Distance > 15.0f)
-				Things[FrameAlienIndex].Distance = 15.0f;
+			if(!BackgroundCache.IsValid ||
+			   (BackgroundCache.Width != ScreenWidth) || (BackgroundCache.ScreenHeight != ScreenHeight))
+			{
+				BuildBackgroundCache(&BackgroundCache, ScreenWidth, ScreenHeight,
+									 SkyGradientCol0, SkyGradientCol1, dithered_horizon.dithered_horizon_texture,
+									 dithered_horizon.top_left(), (int)ceilf(fabsf(dithered_horizon.displacement_amount)));
+			}
 			
 			//BeginDrawing();
 			BeginTextureMode(TargetTexture);
 			
 			ClearBackground(PINK);
-			DrawRectangleGradientV(0, 0, ScreenWidth, ScreenHeight/2, SkyGradientCol0, SkyGradientCol1);
 			//DrawFPS(30, 10);
 			
-			// horizon
-			dithered_horizon.draw(dtForFrame);
+			//NOTE(moritz): Sky gradient and horizon come from the cache
+			int HorizonWobble = dithered_horizon.update(dtForFrame);
+			DrawBackgroundCache(&BackgroundCache, HorizonWobble);
 			
 			//NOTE(moritz): Parallax background
 			Vector2 SunsetP;
@@ -2168,19 +6585,27 @@ And then the game loads in the textures with mipmaps included.
 			
 			skyline.draw(dtForFrame, accumulatedVelocity);
 			
-			//NOTE(moritz): Ground gradient
-			DrawRectangleGradientV(0, ScreenHeight/2, ScreenWidth, ScreenHeight/2,
-								   GrassGradientCol0, GrassGradientCol1);
+			int SunsetPixels = RectPixelCount({SunsetP.x, SunsetP.y, (float)SunsetTexture.width, (float)SunsetTexture.height},
+											  fScreenWidth, fScreenHeight);
+			FrameStats.BackgroundPixels = (BackgroundCache.Width*BackgroundCache.BandHeight + SunsetPixels +
+										   skyline.layerPixelCount());
+			FrameStats.BackgroundPixelsLayered = (ScreenWidth*(ScreenHeight/2) + SunsetPixels +
+												  RectPixelCount({dithered_horizon.top_left().x, dithered_horizon.top_left().y + (float)HorizonWobble,
+														  (float)dithered_horizon.dithered_horizon_texture.width,
+														  (float)dithered_horizon.dithered_horizon_texture.height},
+														  fScreenWidth, fScreenHeight) +
+												  SKYLINE_LAYER_COUNT*skyline.layerPixelCount());
 			
+			//NOTE(moritz): Ground gradient is part of the road spans now
 			DrawRoad(PlayerP, MaxDistance, fScreenWidth, fScreenHeight, DepthLines, DepthLineCount,
-					 &ActiveRoadList, PlayerBaseXOffset);
+					 RoadCenterX, GrassGradientCol0, GrassGradientCol1);
 			
 			//NOTE(moritz): Draw things
-			for(int ThingIndex = 0;
-				ThingIndex < NumberOfThings;
-				++ThingIndex)
+			for(int SortIndex = 0;
+				SortIndex < ThingStore.Count;
+				++SortIndex)
 			{
-				DrawBillboard(Things[ThingIndex].Billboard, Things + ThingIndex);
+				DrawBillboard(SortedThings[SortIndex]->Billboard, SortedThings[SortIndex]);
 			}
 			
 			//NOTE(moritz): Draw player car
@@ -2195,13 +6620,12 @@ And then the game loads in the textures with mipmaps included.
 			crosshair.draw(dtForFrame);
 			bool isLeftPressed = IsMouseButtonReleased(MOUSE_BUTTON_LEFT);
 			
-			//bool inImage = isImageClicked(SunsetP, SunImage);
-			bool inImage = false;
-			if(FrameAlienIndex)
-				inImage = isImageClicked(Things[FrameAlienIndex].FramePosition, Things[FrameAlienIndex].FrameScale, AlienImage);
+			//NOTE(moritz): Anything with a pick mask can be targeted: aliens, their bullets and civilian cars
+			thing *PickedThing = PickThing(PickGrid, GetMousePosition());
+			bool inImage = (PickedThing != 0);
 			int new_crosshair_state = inImage ? 1 : 0;
 			if(crosshair.state == 0 && new_crosshair_state == 1) {
-				PlaySound(crosshair_blip);
+				PlaySfx(&SfxMixer, Sfx_CrosshairBlip, 0.5f);
 			}
 			crosshair.state = new_crosshair_state;
 			
@@ -2209,8 +6633,23 @@ And then the game loads in the textures with mipmaps included.
 				
 				if(!lazer_l.isRunning && !lazer_r.isRunning)
 				{
-					AlienHitCount += 10;
-					PlaySound(lazer_shot);
+					if(PickedThing->IsBullet)
+					{
+						DeleteThing(&ThingStore, PickedThing);
+					}
+					else if(PickedThing->IsAlien)
+					{
+						AlienHitCount += 10;
+					}
+					else
+					{
+						//NOTE(moritz): Shooting a civilian costs what hitting an alien earns
+						AlienHitCount -= 10;
+						
+						if(AlienHitCount < 0)
+							ShowHighScore = true;
+					}
+					PlaySfx(&SfxMixer, Sfx_Lazer);
 				}
 				
 				if(!lazer_l.isRunning) {
@@ -2261,7 +6700,7 @@ And then the game loads in the textures with mipmaps included.
 				
 				Color LineColor = ORANGE;
 				if(Segment == ActiveRoadList.First->Next)
-					LineColor = Lerp(ORANGE, CurveForceT, RED);
+					LineColor = LerpM(ORANGE, ClampM(0.0f, 1.0f - Segment->Position, 1.0f), RED);
 				
 				DrawLineEx(MarkerStart, MarkerEnd, 4.0f, LineColor);
 			}
@@ -2295,6 +6734,9 @@ And then the game loads in the textures with mipmaps included.
 			EndShaderMode();
 			
 			DrawText(TextFormat("SCORE %d", AlienHitCount), 300, 10, 40, WHITE);
+			
+			if(ShowFrameStats)
+				DrawFrameStats(10, 60, &RoadBenchmark);
 		}
 		else
 		{
@@ -2307,9 +6749,10 @@ And then the game loads in the textures with mipmaps included.
 		
 		
 		
+		RecordFrameTime((float)(GetTime() - FrameWorkStartTime));
 		EndDrawing();
 		
-		UpdateMusicStream(Music);
+		UpdateAudio(&AudioStartup);
 		
 		//---------------------------------------------------------
 #ifndef WEB_BUILD
@@ -2318,7 +6761,8 @@ And then the game loads in the textures with mipmaps included.
 #endif
 	}
 	
-	UnloadSound(lazer_shot);
+	CloseAudio(&AudioStartup);
 	CloseWindow();
 	return(0);
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,147 @@
+# Packs the game's assets into one archive of pre-decoded blobs, so startup is a single
+# map/read of one file instead of opening and decoding every png/wav on its own.
+#
+# usage: pack_assets.py [--deflate] output.pak input files...
+#
+#   .png -> RGBA8 pixels
+#   .wav -> PCM samples (16 bit or 8 bit, as they are in the file)
+#   anything else (e.g. the baked .mip files) -> stored as is
+#
+# A .wav is left out when a non empty .sfa of the same name is packed too (see encode_sfx.py),
+# empty .sfa files (sounds the encoder kept as pcm) are left out themselves.
+# A .png is left out when a .mip of the same name is packed, the game only uses the mips then.
+#
+# --deflate (the web pack): every blob that gets at least DEFLATE_MIN_SAVING smaller is stored
+# raw deflated, the game inflates it while loading. Decoded pixels are mostly empty space, the
+# mp3/.sfa stay stored since they don't shrink.
+#
+# .pak layout (little endian):
+#   u32 magic 'SFPK', u32 version, u32 entry_count, u32 pad
+#   entry_count entries of:
+#     char name[48] (zero terminated file name without directory)
+#     u32 type, u32 offset, u32 size
+#     s32 params[5] (image: width, height, 0, 0, 0 / sound: frame count, sample rate, sample size, channels, 0)
+#                   (params[4] is the inflated size of a deflated blob, 0 when it is stored as is)
+#   then the blobs, each starting 16 byte aligned
+import glob
+import os
+import struct
+import sys
+import zlib
+
+from bake_mips import decode_png
+
+PACK_MAGIC = 0x4b504653 # 'SFPK'
+PACK_VERSION = 2
+
+PACK_NAME_SIZE = 48
+
+ASSET_TYPE_RAW = 0
+ASSET_TYPE_IMAGE = 1
+ASSET_TYPE_SOUND = 2
+
+DEFLATE_MIN_SAVING = 0.1
+
+def decode_wav(path):
+  with open(path, 'rb') as f:
+    data = f.read()
+  if data[:4] != b'RIFF' or data[8:12] != b'WAVE':
+    raise ValueError(path + ': not a wav')
+
+  pos = 12
+  fmt = None
+  samples = None
+  while pos + 8 <= len(data):
+    chunk_type, length = struct.unpack('<4sI', data[pos:pos + 8])
+    chunk = data[pos + 8:pos + 8 + length]
+    pos += 8 + length + (length & 1)
+    if chunk_type == b'fmt ':
+      fmt = struct.unpack('<HHIIHH', chunk[:16])
+    elif chunk_type == b'data':
+      samples = chunk
+
+  audio_format, channels, sample_rate, _, _, sample_size = fmt
+  if audio_format != 1 or sample_size not in (8, 16):
+    raise ValueError(path + ': only 8/16 bit pcm wavs are supported')
+
+  frame_count = len(samples)//(channels*sample_size//8)
+  return (frame_count, sample_rate, sample_size, channels, 0), samples
+
+def main():
+  args = sys.argv[1:]
+  deflate = (len(args) > 0) and (args[0] == '--deflate')
+  if deflate:
+    args = args[1:]
+  if len(args) < 2:
+    print('usage: pack_assets.py [--deflate] output.pak input files...')
+    sys.exit(1)
+
+  # NOTE: windows' shell doesn't expand wildcards, so do it here
+  paths = []
+  for arg in args[1:]:
+    paths += sorted(glob.glob(arg)) if ('*' in arg) else [arg]
+
+  compact_sounds = set()
+  baked_mips = set()
+  for path in paths:
+    name, extension = os.path.splitext(os.path.basename(path))
+    if extension.lower() == '.sfa' and os.path.getsize(path) > 0:
+      compact_sounds.add(name)
+    if extension.lower() == '.mip':
+      baked_mips.add(name)
+
+  entries = []
+  for path in paths:
+    name = os.path.basename(path)
+    if len(name) >= PACK_NAME_SIZE:
+      raise ValueError(name + ': name too long for the pack')
+
+    stem, extension = os.path.splitext(name)
+    extension = extension.lower()
+    if extension == '.sfa' and stem not in compact_sounds:
+      continue
+    if extension == '.wav' and stem in compact_sounds:
+      continue
+    if extension == '.png' and stem in baked_mips:
+      continue
+
+    if extension == '.png':
+      width, height, pixels = decode_png(path)
+      entries.append((name, ASSET_TYPE_IMAGE, (width, height, 0, 0, 0), bytes(pixels)))
+    elif extension == '.wav':
+      params, samples = decode_wav(path)
+      entries.append((name, ASSET_TYPE_SOUND, params, samples))
+    else:
+      with open(path, 'rb') as f:
+        entries.append((name, ASSET_TYPE_RAW, (0, 0, 0, 0, 0), f.read()))
+
+  header_size = 16
+  entry_size = PACK_NAME_SIZE + 12 + 20
+  offset = header_size + entry_size*len(entries)
+
+  index = bytearray()
+  blobs = bytearray()
+  for name, asset_type, params, blob in entries:
+    if deflate:
+      # NOTE: Raw deflate (no zlib header), that is what the game's inflater reads
+      compressor = zlib.compressobj(9, zlib.DEFLATED, -15)
+      deflated = compressor.compress(blob) + compressor.flush()
+      if len(deflated) <= (1.0 - DEFLATE_MIN_SAVING)*len(blob):
+        params = params[:4] + (len(blob),)
+        blob = deflated
+
+    padding = (-offset) % 16
+    blobs += bytes(padding)
+    offset += padding
+    index += struct.pack('<%dsIII5i' % PACK_NAME_SIZE, name.encode('ascii'), asset_type,
+                         offset, len(blob), *params)
+    blobs += blob
+    offset += len(blob)
+
+  with open(args[0], 'wb') as f:
+    f.write(struct.pack('<IIII', PACK_MAGIC, PACK_VERSION, len(entries), 0))
+    f.write(index)
+    f.write(blobs)
+
+if __name__ == '__main__':
+  main()
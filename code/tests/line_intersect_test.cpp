@@ -0,0 +1,178 @@
+/*
+NOTE(moritz):
+Runs segments through the lane kernel (LineLineIntersectBatch) and the scalar LineLineIntersect
+and fails unless the hit masks are identical, bit for bit.
+Random segments, plus degenerate ones: collinear overlapping/disjoint, touching endpoints,
+T-junctions, parallel and zero length. Small integer coordinates make the degenerate cases
+exact in float, so both sides see the same zeros.
+*/
+#define SYNTH_FORCE_TESTS
+#include "../main.cpp"
+
+#define TEST_ROUND_COUNT 2000
+#define TEST_MAX_SEGMENTS 67 //NOTE(moritz): Not a multiple of LANE_WIDTH, so the leftover loop runs too
+
+struct intersect_test
+{
+	int RoundCount;
+	int SegmentCount;
+	int HitCount;
+	int FailCount;
+	
+	float StartX[TEST_MAX_SEGMENTS];
+	float StartY[TEST_MAX_SEGMENTS];
+	float EndX[TEST_MAX_SEGMENTS];
+	float EndY[TEST_MAX_SEGMENTS];
+	
+	segment_soa Segments;
+};
+
+inline Vector2
+RandomLatticePoint(random_series *Series)
+{
+	Vector2 Result = {(float)((int)(XORShift32(Series) % 9) - 4), (float)((int)(XORShift32(Series) % 9) - 4)};
+	return(Result);
+}
+
+inline Vector2
+RandomPoint(random_series *Series)
+{
+	Vector2 Result = {100.0f*RandomBilateral(Series), 100.0f*RandomBilateral(Series)};
+	return(Result);
+}
+
+void
+BeginRound(intersect_test *Test)
+{
+	Test->Segments = {};
+	Test->Segments.Capacity = TEST_MAX_SEGMENTS;
+	Test->Segments.StartX = Test->StartX;
+	Test->Segments.StartY = Test->StartY;
+	Test->Segments.EndX   = Test->EndX;
+	Test->Segments.EndY   = Test->EndY;
+}
+
+void
+CheckRound(intersect_test *Test, Vector2 P1, Vector2 P2)
+{
+	//NOTE(moritz): Garbage in the mask up front, the kernel has to clear it itself
+	unsigned int HitMask[(TEST_MAX_SEGMENTS + 31)/32];
+	for(int WordIndex = 0;
+		WordIndex < (int)ArrayCount(HitMask);
+		++WordIndex)
+	{
+		HitMask[WordIndex] = 0xA5A5A5A5;
+	}
+	
+	segment_soa *Segments = &Test->Segments;
+	LineLineIntersectBatch(P1, P2, Segments, HitMask);
+	
+	for(int SegmentIndex = 0;
+		SegmentIndex < Segments->Count;
+		++SegmentIndex)
+	{
+		Vector2 P3 = {Segments->StartX[SegmentIndex], Segments->StartY[SegmentIndex]};
+		Vector2 P4 = {Segments->EndX[SegmentIndex], Segments->EndY[SegmentIndex]};
+		
+		bool Batched = (HitMask[SegmentIndex/32] >> (SegmentIndex % 32)) & 1;
+		bool Scalar  = LineLineIntersect(P1, P2, P3, P4);
+		
+		if(Batched != Scalar)
+		{
+			++Test->FailCount;
+			printf("FAIL round %d segment %d: (%g, %g)-(%g, %g) against (%g, %g)-(%g, %g), batched %d, scalar %d\n",
+				   Test->RoundCount, SegmentIndex, P1.x, P1.y, P2.x, P2.y, P3.x, P3.y, P4.x, P4.y, Batched, Scalar);
+		}
+		
+		Test->HitCount += Scalar;
+	}
+	
+	++Test->RoundCount;
+	Test->SegmentCount += Segments->Count;
+}
+
+int
+main()
+{
+	intersect_test *Test = (intersect_test *)calloc(1, sizeof(intersect_test));
+	random_series Series = {1234};
+	
+	//NOTE(moritz): Hand picked degenerate cases against a fixed edge, like the player's collision edge
+	{
+		Vector2 P1 = {0.0f, -1.0f};
+		Vector2 P2 = {0.0f,  1.0f};
+		
+		BeginRound(Test);
+		PushSegment(&Test->Segments, {0.0f, -2.0f}, {0.0f, 2.0f});   //Collinear, covering
+		PushSegment(&Test->Segments, {0.0f, 0.0f}, {0.0f, 0.5f});    //Collinear, inside
+		PushSegment(&Test->Segments, {0.0f, 1.0f}, {0.0f, 3.0f});    //Collinear, touching an end
+		PushSegment(&Test->Segments, {0.0f, 2.0f}, {0.0f, 3.0f});    //Collinear, disjoint
+		PushSegment(&Test->Segments, {1.0f, -1.0f}, {1.0f, 1.0f});   //Parallel
+		PushSegment(&Test->Segments, {-1.0f, 1.0f}, {0.0f, 1.0f});   //Ends on P2
+		PushSegment(&Test->Segments, {0.0f, -1.0f}, {1.0f, -3.0f});  //Starts on P1
+		PushSegment(&Test->Segments, {-1.0f, 0.0f}, {0.0f, 0.0f});   //T-junction
+		PushSegment(&Test->Segments, {-1.0f, 0.0f}, {1.0f, 0.0f});   //Plain crossing
+		PushSegment(&Test->Segments, {-1.0f, 1.0f}, {1.0f, 1.0f});   //Crossing through P2
+		PushSegment(&Test->Segments, {-1.0f, 2.0f}, {1.0f, 2.0f});   //Miss past P2
+		PushSegment(&Test->Segments, {0.0f, 0.0f}, {0.0f, 0.0f});    //Zero length, on the edge
+		PushSegment(&Test->Segments, {3.0f, 3.0f}, {3.0f, 3.0f});    //Zero length, off the edge
+		PushSegment(&Test->Segments, {-0.0f, -1.0f}, {-0.0f, 1.0f}); //Same edge, negative zeros
+		CheckRound(Test, P1, P2);
+		
+		//NOTE(moritz): Zero length edge itself
+		CheckRound(Test, P1, P1);
+	}
+	
+	for(int Round = 0;
+		Round < TEST_ROUND_COUNT;
+		++Round)
+	{
+		BeginRound(Test);
+		
+		bool Lattice = (Round & 1);
+		Vector2 P1 = Lattice ? RandomLatticePoint(&Series) : RandomPoint(&Series);
+		Vector2 P2 = Lattice ? RandomLatticePoint(&Series) : RandomPoint(&Series);
+		
+		int Count = (int)(XORShift32(&Series) % (TEST_MAX_SEGMENTS + 1));
+		for(int SegmentIndex = 0;
+			SegmentIndex < Count;
+			++SegmentIndex)
+		{
+			Vector2 P3;
+			Vector2 P4;
+			switch(XORShift32(&Series) % 4)
+			{
+				//NOTE(moritz): Collinear with the edge, somewhere along its line
+				case 0:
+				{
+					float A = (float)((int)(XORShift32(&Series) % 9) - 4)*0.5f;
+					float B = (float)((int)(XORShift32(&Series) % 9) - 4)*0.5f;
+					P3 = P1 + A*(P2 - P1);
+					P4 = P1 + B*(P2 - P1);
+				} break;
+				
+				//NOTE(moritz): Sharing an endpoint with the edge
+				case 1:
+				{
+					P3 = (XORShift32(&Series) & 1) ? P1 : P2;
+					P4 = Lattice ? RandomLatticePoint(&Series) : RandomPoint(&Series);
+				} break;
+				
+				default:
+				{
+					P3 = Lattice ? RandomLatticePoint(&Series) : RandomPoint(&Series);
+					P4 = Lattice ? RandomLatticePoint(&Series) : RandomPoint(&Series);
+				} break;
+			}
+			
+			PushSegment(&Test->Segments, P3, P4);
+		}
+		
+		CheckRound(Test, P1, P2);
+	}
+	
+	printf("line_intersect_test: %d rounds, %d segments (%d hits), %d lanes, %d mismatches\n",
+		   Test->RoundCount, Test->SegmentCount, Test->HitCount, LANE_WIDTH, Test->FailCount);
+	
+	return(Test->FailCount ? 1 : 0);
+}
@@ -0,0 +1,130 @@
+/*
+NOTE(moritz):
+Builds Bezier road LUTs the way the game does and checks every lookup against dense Bezier3
+evaluation. Fails when any segment is off by more than ROAD_LUT_MAX_ERROR pixels.
+Covers every ddX preset following every other one (with a spread of C1.y jitter rolls),
+and a long chain generated through NextRoadSegment like the main loop does it.
+*/
+#define SYNTH_FORCE_TESTS
+#include "../main.cpp"
+
+//NOTE(moritz): DepthLineCount at the game's 450 pixel screen height
+#define TEST_MAX_DISTANCE 225.0f
+#define TEST_ROLL_COUNT 16
+#define TEST_CHAIN_LENGTH 512
+#define TEST_DENSE_SAMPLES 4096
+
+struct lut_error_stats
+{
+	int SegmentCount;
+	int FailCount;
+	float MaxError;
+};
+
+void
+CheckRoadSegmentLUT(lut_error_stats *Stats, road_segment *Segment, const char *Label, int Index)
+{
+	float Error = RoadSegmentLUTError(Segment, TEST_DENSE_SAMPLES);
+	
+	++Stats->SegmentCount;
+	Stats->MaxError = Max(Stats->MaxError, Error);
+	if(!(Error <= ROAD_LUT_MAX_ERROR))
+	{
+		++Stats->FailCount;
+		printf("FAIL %s %d: LUT error %f px exceeds %f px\n", Label, Index, Error, ROAD_LUT_MAX_ERROR);
+	}
+}
+
+int
+main()
+{
+	lut_error_stats Stats = {};
+	
+	//NOTE(moritz): Every preset after every preset. The count is not a multiple of LANE_WIDTH,
+	//so the partial last batch gets covered too.
+	int PresetCount = (int)ArrayCount(RoadPresets);
+	int PairCount   = PresetCount*PresetCount*TEST_ROLL_COUNT + 1;
+	
+	road_segment *Prevs     = (road_segment *)calloc(PairCount, sizeof(road_segment));
+	road_segment *Segments  = (road_segment *)calloc(PairCount, sizeof(road_segment));
+	road_segment **Batch    = (road_segment **)malloc(sizeof(road_segment *)*PairCount);
+	
+	int PairIndex = 0;
+	for(int PrevPreset = 0;
+		PrevPreset < PresetCount;
+		++PrevPreset)
+	{
+		for(int Preset = 0;
+			Preset < PresetCount;
+			++Preset)
+		{
+			for(unsigned int Roll = 0;
+				Roll < TEST_ROLL_COUNT;
+				++Roll)
+			{
+				road_segment *Prev = Prevs + PairIndex;
+				Prev->ddX = RoadPresets[PrevPreset];
+				InitSegmentBezier(Prev, 0, 7919u*Roll, TEST_MAX_DISTANCE);
+				
+				road_segment *Segment = Segments + PairIndex;
+				Segment->ddX = RoadPresets[Preset];
+				InitSegmentBezier(Segment, Prev, Roll, TEST_MAX_DISTANCE);
+				
+				Batch[PairIndex++] = Segment;
+			}
+		}
+	}
+	
+	//NOTE(moritz): The initial straight segment
+	Segments[PairIndex].ddX = 0.0f;
+	InitSegmentBezier(Segments + PairIndex, 0, 0, TEST_MAX_DISTANCE);
+	Batch[PairIndex] = Segments + PairIndex;
+	
+	SetRoadSegmentLUTs(Batch, PairCount);
+	
+	for(int Index = 0;
+		Index < PairCount;
+		++Index)
+	{
+		CheckRoadSegmentLUT(&Stats, Batch[Index], "preset pair", Index);
+	}
+	
+	//NOTE(moritz): Long chain from the game's seed, handed out through the pending list
+	road_pool Pool = {};
+	road_list ActiveRoadList  = {};
+	road_list PendingRoadList = {};
+	random_series Entropy = {420};
+	
+	road_segment *Initial = AllocateRoadSegment(&Pool);
+	Initial->Position = 0.0f;
+	Initial->ddX = 0.0f;
+	InitSegmentBezier(Initial, 0, 0, TEST_MAX_DISTANCE);
+	SetRoadSegmentLUTs(&Initial, 1);
+	Append(&ActiveRoadList, Initial);
+	
+	for(int Index = 0;
+		Index < TEST_CHAIN_LENGTH;
+		++Index)
+	{
+		road_segment *Segment = NextRoadSegment(&Pool, &PendingRoadList, ActiveRoadList.Last,
+												&Entropy, TEST_MAX_DISTANCE);
+		
+		if(Segment->Start.x != ActiveRoadList.Last->End.x)
+		{
+			++Stats.FailCount;
+			printf("FAIL chain %d: starts at x %f, previous segment ends at %f\n", Index,
+				   Segment->Start.x, ActiveRoadList.Last->End.x);
+		}
+		
+		Append(&ActiveRoadList, Segment);
+		CheckRoadSegmentLUT(&Stats, Segment, "chain", Index);
+		
+		if(ActiveRoadList.First->Next->Next)
+			DeleteHeadSegment(&ActiveRoadList, &Pool);
+	}
+	
+	printf("road_lut_test: %d segments, %d lanes, max error %f px (limit %f px), %d failed\n",
+		   Stats.SegmentCount, LANE_WIDTH, Stats.MaxError, ROAD_LUT_MAX_ERROR, Stats.FailCount);
+	
+	return(Stats.FailCount ? 1 : 0);
+}
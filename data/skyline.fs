@@ -0,0 +1,41 @@
+#version 100
+
+#ifdef GL_FRAGMENT_PRECISION_HIGH
+precision highp float;
+#else
+precision mediump float;
+#endif
+
+//Input vertex attributes (from vertex shader)
+varying vec2 fragTexCoord;
+varying vec4 fragColor;
+
+//Input uniform values
+uniform sampler2D texture0;
+
+// All skyline layers stacked on top of each other in texture0, back to front.
+// fragTexCoord.x counts in layer widths, fragTexCoord.y covers the first layer.
+#define LAYER_COUNT 5
+
+// Pan of each layer, in layer widths
+uniform float layerOffsets[LAYER_COUNT];
+
+void main()
+{
+    vec3 color = vec3(0.0);
+    float alpha = 0.0;
+
+    for(int i = 0; i < LAYER_COUNT; ++i)
+    {
+        vec2 uv = vec2(fract(fragTexCoord.x - layerOffsets[i]), fragTexCoord.y + float(i)/float(LAYER_COUNT));
+        vec4 texel = texture2D(texture0, uv);
+
+        // Back to front over, premultiplied
+        color = texel.rgb*texel.a + color*(1.0 - texel.a);
+        alpha = texel.a + alpha*(1.0 - texel.a);
+    }
+
+    if(alpha <= 0.0) discard;
+
+    gl_FragColor = vec4(color/alpha, alpha)*fragColor;
+}